@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# Run wrk against wrk-echo over loopback and report requests/sec per wrk
+# thread, so changes to wrk's hot paths can be compared locally.
+#
+#   bench/loopback.sh [-d duration] [-c conns/thread] [-s size] [-o file] [threads...]
+#
+# Results are appended to the -o file as "version threads req/s req/s/thread".
+
+set -e
+
+DURATION=10s
+CONNS=16
+SIZE=13
+PORT=${PORT:-18080}
+OUT=
+
+while getopts "d:c:s:o:" opt; do
+    case $opt in
+        d) DURATION=$OPTARG ;;
+        c) CONNS=$OPTARG ;;
+        s) SIZE=$OPTARG ;;
+        o) OUT=$OPTARG ;;
+        *) sed -n '3,8s/^# \{0,1\}//p' "$0"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+CPUS=$(getconf _NPROCESSORS_ONLN)
+THREADS=${*:-"1 2 4"}
+ECHO_THREADS=${ECHO_THREADS:-$CPUS}
+
+cd "$(dirname "$0")/.."
+make wrk wrk-echo >/dev/null
+
+./wrk-echo -t "$ECHO_THREADS" -s "$SIZE" -b 127.0.0.1 "$PORT" >/dev/null &
+ECHO_PID=$!
+trap 'kill $ECHO_PID 2>/dev/null' EXIT INT TERM
+sleep 1
+kill -0 $ECHO_PID 2>/dev/null || exit 1
+
+VERSION=$(./wrk -v 2>&1 | awk '{ print $2; exit }')
+
+printf "%-8s %14s %14s\n" Threads Requests/sec Per-thread
+for t in $THREADS; do
+    RPS=$(./wrk -t "$t" -c $((t * CONNS)) -d "$DURATION" "http://127.0.0.1:$PORT/" \
+          | awk '/^Requests\/sec:/ { print $2 }')
+    PER=$(echo "$RPS $t" | awk '{ printf "%.2f", $1 / $2 }')
+    printf "%-8s %14s %14s\n" "$t" "$RPS" "$PER"
+    if [ -n "$OUT" ]; then
+        echo "$VERSION $t $RPS $PER" >> "$OUT"
+    fi
+done
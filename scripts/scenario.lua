@@ -0,0 +1,13 @@
+-- example script that demonstrates a multi-step scenario with
+-- data from one response carried into the following requests
+
+function scenario()
+   local status, headers = wrk.step("login", wrk.format("POST", "/login"))
+   local token = headers["X-Token"]
+
+   for i = 1, 3 do
+      wrk.step("list", wrk.format("GET", "/items?page=" .. i, { ["X-Token"] = token }))
+   end
+
+   wrk.step("logout", wrk.format("POST", "/logout", { ["X-Token"] = token }))
+end
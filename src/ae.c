@@ -60,26 +60,119 @@
     #endif
 #endif
 
+/* File events are kept in an open addressed table keyed by fd, so memory
+ * follows the number of registered descriptors rather than their values,
+ * which are shared by every thread in the process. */
+static unsigned int aeHashFd(aeEventLoop *eventLoop, int fd) {
+    return ((unsigned int) fd * 2654435761U) & (eventLoop->eventsize - 1);
+}
+
+static aeFileEvent *aeFindFileEvent(aeEventLoop *eventLoop, int fd) {
+    unsigned int mask = eventLoop->eventsize - 1;
+    unsigned int i;
+
+    for (i = aeHashFd(eventLoop, fd); eventLoop->events[i].fd != -1; i = (i+1) & mask)
+        if (eventLoop->events[i].fd == fd) return &eventLoop->events[i];
+    return NULL;
+}
+
+static aeFileEvent *aeAllocEvents(int size) {
+    aeFileEvent *events = zmalloc(sizeof(aeFileEvent)*size);
+    int i;
+
+    if (events == NULL) return NULL;
+    for (i = 0; i < size; i++) {
+        events[i].fd = -1;
+        events[i].mask = AE_NONE;
+    }
+    return events;
+}
+
+static aeFileEvent *aeInsertFileEvent(aeEventLoop *eventLoop, int fd) {
+    unsigned int mask = eventLoop->eventsize - 1;
+    unsigned int i = aeHashFd(eventLoop, fd);
+
+    while (eventLoop->events[i].fd != -1) i = (i+1) & mask;
+    eventLoop->events[i].fd = fd;
+    eventLoop->events[i].mask = AE_NONE;
+    eventLoop->count++;
+    if (fd > eventLoop->maxfd)
+        eventLoop->maxfd = fd;
+    return &eventLoop->events[i];
+}
+
+/* Delete with backward shift so lookups never need tombstones. */
+static void aeRemoveFileEvent(aeEventLoop *eventLoop, aeFileEvent *fe) {
+    unsigned int mask = eventLoop->eventsize - 1;
+    unsigned int i = fe - eventLoop->events, j = i, k;
+
+    for (;;) {
+        j = (j+1) & mask;
+        if (eventLoop->events[j].fd == -1) break;
+        k = aeHashFd(eventLoop, eventLoop->events[j].fd);
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        eventLoop->events[i] = eventLoop->events[j];
+        i = j;
+    }
+    eventLoop->events[i].fd = -1;
+    eventLoop->events[i].mask = AE_NONE;
+    if (--eventLoop->count == 0)
+        eventLoop->maxfd = -1;
+}
+
+static int aeResizeEvents(aeEventLoop *eventLoop, int size) {
+    aeFileEvent *old = eventLoop->events, *fe;
+    int oldsize = eventLoop->eventsize;
+    int i;
+
+    if ((eventLoop->events = aeAllocEvents(size)) == NULL) {
+        eventLoop->events = old;
+        return AE_ERR;
+    }
+    eventLoop->eventsize = size;
+    eventLoop->count = 0;
+    for (i = 0; i < oldsize; i++) {
+        if (old[i].fd == -1) continue;
+        fe = aeInsertFileEvent(eventLoop, old[i].fd);
+        *fe = old[i];
+    }
+    zfree(old);
+    return AE_OK;
+}
+
+static int aeResizeSetSize(aeEventLoop *eventLoop, int setsize) {
+    aeFiredEvent *fired;
+
+    if (aeApiResize(eventLoop, setsize) == -1) return AE_ERR;
+    if ((fired = zrealloc(eventLoop->fired, sizeof(aeFiredEvent)*setsize)) == NULL)
+        return AE_ERR;
+    eventLoop->fired = fired;
+    eventLoop->setsize = setsize;
+    return AE_OK;
+}
+
 aeEventLoop *aeCreateEventLoop(int setsize) {
     aeEventLoop *eventLoop;
-    int i;
+    int eventsize = 16;
+
+    while (eventsize < setsize * 2) eventsize *= 2;
 
     if ((eventLoop = zmalloc(sizeof(*eventLoop))) == NULL) goto err;
-    eventLoop->events = zmalloc(sizeof(aeFileEvent)*setsize);
+    eventLoop->events = aeAllocEvents(eventsize);
     eventLoop->fired = zmalloc(sizeof(aeFiredEvent)*setsize);
     if (eventLoop->events == NULL || eventLoop->fired == NULL) goto err;
     eventLoop->setsize = setsize;
+    eventLoop->eventsize = eventsize;
+    eventLoop->count = 0;
     eventLoop->lastTime = time(NULL);
     eventLoop->timeEventHead = NULL;
     eventLoop->timeEventNextId = 0;
     eventLoop->stop = 0;
     eventLoop->maxfd = -1;
     eventLoop->beforesleep = NULL;
+    eventLoop->aftersleep = NULL;
+    eventLoop->privdata = NULL;
     if (aeApiCreate(eventLoop) == -1) goto err;
-    /* Events with mask == AE_NONE are not set. So let's initialize the
-     * vector with it. */
-    for (i = 0; i < setsize; i++)
-        eventLoop->events[i].mask = AE_NONE;
     return eventLoop;
 
 err:
@@ -105,46 +198,43 @@ void aeStop(aeEventLoop *eventLoop) {
 int aeCreateFileEvent(aeEventLoop *eventLoop, int fd, int mask,
         aeFileProc *proc, void *clientData)
 {
-    if (fd >= eventLoop->setsize) {
-        errno = ERANGE;
-        return AE_ERR;
+    aeFileEvent *fe = aeFindFileEvent(eventLoop, fd);
+
+    if (fe == NULL) {
+        if ((eventLoop->count+1)*2 > eventLoop->eventsize &&
+            aeResizeEvents(eventLoop, eventLoop->eventsize*2) == AE_ERR)
+            return AE_ERR;
+        if (eventLoop->count+1 > eventLoop->setsize &&
+            aeResizeSetSize(eventLoop, eventLoop->setsize*2) == AE_ERR)
+            return AE_ERR;
+        fe = aeInsertFileEvent(eventLoop, fd);
     }
-    aeFileEvent *fe = &eventLoop->events[fd];
 
-    if (aeApiAddEvent(eventLoop, fd, mask) == -1)
+    if (aeApiAddEvent(eventLoop, fd, mask) == -1) {
+        if (fe->mask == AE_NONE) aeRemoveFileEvent(eventLoop, fe);
         return AE_ERR;
+    }
     fe->mask |= mask;
     if (mask & AE_READABLE) fe->rfileProc = proc;
     if (mask & AE_WRITABLE) fe->wfileProc = proc;
     fe->clientData = clientData;
-    if (fd > eventLoop->maxfd)
-        eventLoop->maxfd = fd;
     return AE_OK;
 }
 
 void aeDeleteFileEvent(aeEventLoop *eventLoop, int fd, int mask)
 {
-    if (fd >= eventLoop->setsize) return;
-    aeFileEvent *fe = &eventLoop->events[fd];
+    aeFileEvent *fe = aeFindFileEvent(eventLoop, fd);
 
-    if (fe->mask == AE_NONE) return;
+    if (fe == NULL || fe->mask == AE_NONE) return;
     fe->mask = fe->mask & (~mask);
-    if (fd == eventLoop->maxfd && fe->mask == AE_NONE) {
-        /* Update the max fd */
-        int j;
-
-        for (j = eventLoop->maxfd-1; j >= 0; j--)
-            if (eventLoop->events[j].mask != AE_NONE) break;
-        eventLoop->maxfd = j;
-    }
     aeApiDelEvent(eventLoop, fd, mask);
+    if (fe->mask == AE_NONE) aeRemoveFileEvent(eventLoop, fe);
 }
 
 int aeGetFileEvents(aeEventLoop *eventLoop, int fd) {
-    if (fd >= eventLoop->setsize) return 0;
-    aeFileEvent *fe = &eventLoop->events[fd];
+    aeFileEvent *fe = aeFindFileEvent(eventLoop, fd);
 
-    return fe->mask;
+    return fe ? fe->mask : AE_NONE;
 }
 
 static void aeGetTime(long *seconds, long *milliseconds)
@@ -330,7 +420,7 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags)
      * file events to process as long as we want to process time
      * events, in order to sleep until the next time event is ready
      * to fire. */
-    if (eventLoop->maxfd != -1 ||
+    if (eventLoop->count != 0 ||
         ((flags & AE_TIME_EVENTS) && !(flags & AE_DONT_WAIT))) {
         int j;
         aeTimeEvent *shortest = NULL;
@@ -368,20 +458,25 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags)
         }
 
         numevents = aeApiPoll(eventLoop, tvp);
+        if (eventLoop->aftersleep != NULL)
+            eventLoop->aftersleep(eventLoop);
         for (j = 0; j < numevents; j++) {
-            aeFileEvent *fe = &eventLoop->events[eventLoop->fired[j].fd];
+            aeFileEvent *fe = aeFindFileEvent(eventLoop, eventLoop->fired[j].fd);
             int mask = eventLoop->fired[j].mask;
             int fd = eventLoop->fired[j].fd;
             int rfired = 0;
 
 	    /* note the fe->mask & mask & ... code: maybe an already processed
              * event removed an element that fired and we still didn't
-             * processed, so we check if the event is still valid. */
-            if (fe->mask & mask & AE_READABLE) {
+             * processed, so we check if the event is still valid. The
+             * read handler may also move entries in the table so look the
+             * fd up again before the write handler. */
+            if (fe && fe->mask & mask & AE_READABLE) {
                 rfired = 1;
                 fe->rfileProc(eventLoop,fd,fe->clientData,mask);
+                fe = aeFindFileEvent(eventLoop, fd);
             }
-            if (fe->mask & mask & AE_WRITABLE) {
+            if (fe && fe->mask & mask & AE_WRITABLE) {
                 if (!rfired || fe->wfileProc != fe->rfileProc)
                     fe->wfileProc(eventLoop,fd,fe->clientData,mask);
             }
@@ -433,3 +528,7 @@ char *aeGetApiName(void) {
 void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep) {
     eventLoop->beforesleep = beforesleep;
 }
+
+void aeSetAfterSleepProc(aeEventLoop *eventLoop, aeAfterSleepProc *aftersleep) {
+    eventLoop->aftersleep = aftersleep;
+}
@@ -58,6 +58,16 @@ static int aeApiCreate(aeEventLoop *eventLoop) {
     return 0;    
 }
 
+static int aeApiResize(aeEventLoop *eventLoop, int setsize) {
+    aeApiState *state = eventLoop->apidata;
+    struct kevent *events;
+
+    events = zrealloc(state->events, sizeof(struct kevent)*setsize);
+    if (!events) return -1;
+    state->events = events;
+    return 0;
+}
+
 static void aeApiFree(aeEventLoop *eventLoop) {
     aeApiState *state = eventLoop->apidata;
 
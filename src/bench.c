@@ -0,0 +1,266 @@
+// Copyright (C) 2012 - Will Glozer.  All rights reserved.
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ae.h"
+#include "http_parser.h"
+#include "script.h"
+#include "stats.h"
+#include "zmalloc.h"
+
+// Microbenchmarks for wrk's hot paths. Each case runs a fixed input for
+// a number of iterations and returns how many operations it completed,
+// and the mean time and heap allocations per operation are reported.
+// When linked with --wrap for malloc, calloc, and realloc every heap
+// allocation made by wrk's own objects is counted.
+
+typedef struct {
+    char *name;
+    uint64_t (*run)(uint64_t);
+    uint64_t iterations;
+} bench;
+
+static uint64_t allocs;
+
+#ifdef COUNT_ALLOCS
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+
+void *__wrap_malloc(size_t size) {
+    __sync_fetch_and_add(&allocs, 1);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    __sync_fetch_and_add(&allocs, 1);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    __sync_fetch_and_add(&allocs, 1);
+    return __real_realloc(ptr, size);
+}
+#endif
+
+static uint64_t time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// http_parser_execute on a keep-alive response, fed in one read
+
+static char response[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Server: nginx/1.24.0\r\n"
+    "Date: Sat, 01 Jan 2022 00:00:00 GMT\r\n"
+    "Content-Type: text/html; charset=utf-8\r\n"
+    "Content-Length: 58\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: no-cache\r\n"
+    "\r\n"
+    "<html><head><title>ok</title></head><body>ok</body></html>";
+
+static int parser_noop(http_parser *parser, const char *at, size_t len) {
+    return 0;
+}
+
+static int parser_complete(http_parser *parser) {
+    (*(uint64_t *) parser->data)++;
+    return 0;
+}
+
+static http_parser_settings parser_settings = {
+    .on_header_field     = parser_noop,
+    .on_header_value     = parser_noop,
+    .on_body             = parser_noop,
+    .on_message_complete = parser_complete
+};
+
+static uint64_t bench_parser(uint64_t n) {
+    http_parser parser;
+    uint64_t complete = 0;
+    size_t len = sizeof(response) - 1;
+
+    http_parser_init(&parser, HTTP_RESPONSE);
+    parser.data = &complete;
+
+    for (uint64_t i = 0; i < n; i++) {
+        if (http_parser_execute(&parser, &parser_settings, response, len) != len) {
+            fprintf(stderr, "parser error: %s\n", http_errno_name(HTTP_PARSER_ERRNO(&parser)));
+            exit(1);
+        }
+    }
+
+    return complete;
+}
+
+// stats_record from one thread per CPU into a shared histogram
+
+#define STATS_MAX 1000000
+
+static struct {
+    stats *stats;
+    uint64_t count;
+} shared;
+
+static void *stats_worker(void *arg) {
+    uint64_t seed = (uintptr_t) arg;
+    for (uint64_t i = 0; i < shared.count; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        stats_record(shared.stats, (seed >> 33) % 10000);
+    }
+    return NULL;
+}
+
+static uint64_t bench_stats(uint64_t n) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t threads = cpus > 1 ? cpus : 2;
+    pthread_t tids[threads];
+
+    shared.stats = stats_alloc(STATS_MAX);
+    shared.count = n / threads;
+
+    for (uint64_t i = 0; i < threads; i++) {
+        pthread_create(&tids[i], NULL, stats_worker, (void *) (uintptr_t) (i + 1));
+    }
+    for (uint64_t i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    uint64_t count = shared.stats->count;
+    stats_free(shared.stats);
+    return count;
+}
+
+// buffer_append of a 1MB body in 8k reads into a new connection's buffer
+
+#define BODY_SIZE  (1024 * 1024)
+#define BODY_CHUNK 8192
+
+static uint64_t bench_buffer(uint64_t n) {
+    static char chunk[BODY_CHUNK];
+    uint64_t i;
+
+    for (i = 0; i < n; i++) {
+        buffer b = { 0 };
+        for (size_t len = 0; len < BODY_SIZE; len += BODY_CHUNK) {
+            buffer_append(&b, chunk, BODY_CHUNK);
+        }
+        if (b.cursor - b.buffer != BODY_SIZE) break;
+        free(b.buffer);
+    }
+
+    return i;
+}
+
+// script_request with a request() that formats a new path each time
+
+static char *request_script =
+    "wrk.init({})\n"
+    "local n = 0\n"
+    "function request()\n"
+    "   n = n + 1\n"
+    "   return wrk.format(nil, \"/item/\" .. n)\n"
+    "end\n";
+
+static uint64_t bench_request(uint64_t n) {
+    char *headers[] = { "X-Bench: 1", NULL };
+    lua_State *L = script_create(NULL, "http://127.0.0.1:8080/index.html", headers);
+    char *buf = NULL;
+    size_t len = 0;
+    uint64_t i;
+
+    if (luaL_dostring(L, request_script)) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        exit(1);
+    }
+
+    for (i = 0; i < n; i++) {
+        script_request(L, &buf, &len);
+        if (!len) break;
+    }
+
+    free(buf);
+    lua_close(L);
+    return i;
+}
+
+// aeProcessEvents dispatching readable events on a set of pipes
+
+#define PIPES 64
+
+static void pipe_readable(aeEventLoop *loop, int fd, void *data, int mask) {
+    (*(uint64_t *) data)++;
+}
+
+static uint64_t bench_events(uint64_t n) {
+    aeEventLoop *loop = aeCreateEventLoop(10 + PIPES * 2);
+    int fds[PIPES][2];
+    uint64_t fired = 0;
+
+    for (int i = 0; i < PIPES; i++) {
+        if (pipe(fds[i]) || write(fds[i][1], "x", 1) != 1) {
+            perror("pipe");
+            exit(1);
+        }
+        aeCreateFileEvent(loop, fds[i][0], AE_READABLE, pipe_readable, &fired);
+    }
+
+    while (fired < n) {
+        aeProcessEvents(loop, AE_FILE_EVENTS | AE_DONT_WAIT);
+    }
+
+    for (int i = 0; i < PIPES; i++) {
+        aeDeleteFileEvent(loop, fds[i][0], AE_READABLE);
+        close(fds[i][0]);
+        close(fds[i][1]);
+    }
+    aeDeleteEventLoop(loop);
+
+    return fired;
+}
+
+static bench benches[] = {
+    { "http_parser_execute",         bench_parser,  2000000  },
+    { "stats_record (contended)",    bench_stats,   20000000 },
+    { "buffer_append (1MB body)",    bench_buffer,  200      },
+    { "script_request",              bench_request, 1000000  },
+    { "aeProcessEvents (per event)", bench_events,  5000000  },
+    { NULL,                          NULL,          0        }
+};
+
+int main(int argc, char **argv) {
+    printf("%-28s %12s %14s %12s\n", "Benchmark", "Ops", "ns/op", "allocs/op");
+
+    for (bench *b = benches; b->name; b++) {
+        if (argc > 1 && !strstr(b->name, argv[1])) continue;
+
+        uint64_t before  = allocs;
+        uint64_t start   = time_ns();
+        uint64_t ops     = b->run(b->iterations);
+        uint64_t elapsed = time_ns() - start;
+
+        if (ops == 0) {
+            fprintf(stderr, "%s: no operations completed\n", b->name);
+            exit(1);
+        }
+
+        printf("%-28s %12"PRIu64" %14.1Lf", b->name, ops, (long double) elapsed / ops);
+#ifdef COUNT_ALLOCS
+        printf(" %12.2Lf\n", (long double) (allocs - before) / ops);
+#else
+        (void) before;
+        printf(" %12s\n", "-");
+#endif
+    }
+
+    return 0;
+}
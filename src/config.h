@@ -5,6 +5,7 @@
 #define HAVE_KQUEUE
 #elif defined(__linux__)
 #define HAVE_EPOLL
+#define HAVE_PROCFS
 #elif defined (__sun)
 #define HAVE_EVPORT
 #define _XPG6
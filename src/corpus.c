@@ -0,0 +1,422 @@
+// Copyright (C) 2012 - Will Glozer.  All rights reserved.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "corpus.h"
+#include "http_parser.h"
+#include "zmalloc.h"
+
+typedef struct {
+    uint64_t off;
+    uint64_t len;
+} entry;
+
+typedef struct {
+    char *method;
+    char *path;
+    char *headers;
+    char *body;
+} fields;
+
+struct corpus {
+    char    *data;
+    size_t   size;
+    bool     json;
+    char    *host;
+    entry   *entries;
+    uint64_t count;
+    uint64_t limit;
+};
+
+static void add_entry(corpus *c, uint64_t off, uint64_t len) {
+    if (c->count == c->limit) {
+        c->limit   = c->limit ? c->limit * 2 : 1024;
+        c->entries = zrealloc(c->entries, c->limit * sizeof(entry));
+    }
+    c->entries[c->count].off = off;
+    c->entries[c->count].len = len;
+    c->count++;
+}
+
+static int request_complete(http_parser *parser) {
+    http_parser_pause(parser, 1);
+    return 0;
+}
+
+static bool index_raw(corpus *c, char *file) {
+    http_parser_settings settings = {
+        .on_message_complete = request_complete
+    };
+    http_parser parser;
+    char *p = c->data, *end = c->data + c->size;
+
+    while (p < end) {
+        while (p < end && (*p == '\r' || *p == '\n')) p++;
+        if (p == end) break;
+
+        http_parser_init(&parser, HTTP_REQUEST);
+        size_t n = http_parser_execute(&parser, &settings, p, end - p);
+
+        enum http_errno err = HTTP_PARSER_ERRNO(&parser);
+        if (err != HPE_PAUSED) {
+            const char *msg = err != HPE_OK ? http_errno_description(err) : "incomplete request";
+            fprintf(stderr, "%s: %s at offset %zu\n", file, msg, (size_t) (p - c->data) + n);
+            return false;
+        }
+
+        add_entry(c, p - c->data, n);
+        p += n;
+    }
+
+    return true;
+}
+
+static char *skip_space(char *p, char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    return p;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static char *json_unicode(char *p, char *end, uint32_t *cp) {
+    *cp = 0;
+    if (end - p < 4) return NULL;
+    for (int i = 0; i < 4; i++) {
+        int n = hex_value(*p++);
+        if (n < 0) return NULL;
+        *cp = (*cp << 4) | n;
+    }
+    return p;
+}
+
+static char *utf8_encode(char *o, uint32_t cp) {
+    if (cp < 0x80) {
+        *o++ = cp;
+    } else if (cp < 0x800) {
+        *o++ = 0xC0 | (cp >> 6);
+        *o++ = 0x80 | (cp & 0x3F);
+    } else if (cp < 0x10000) {
+        *o++ = 0xE0 | (cp >> 12);
+        *o++ = 0x80 | ((cp >> 6) & 0x3F);
+        *o++ = 0x80 | (cp & 0x3F);
+    } else {
+        *o++ = 0xF0 | (cp >> 18);
+        *o++ = 0x80 | ((cp >> 12) & 0x3F);
+        *o++ = 0x80 | ((cp >> 6) & 0x3F);
+        *o++ = 0x80 | (cp & 0x3F);
+    }
+    return o;
+}
+
+// Decode the JSON string at p into *out when out is not NULL and
+// return a pointer past its closing quote, or NULL if it is invalid.
+static char *json_string(char *p, char *end, char **out) {
+    if (p == end || *p != '"') return NULL;
+
+    for (p++; p < end; p++) {
+        char c = *p;
+        uint32_t cp, low;
+
+        if (c == '"') return p + 1;
+        if (c == '\\') {
+            if (++p == end) return NULL;
+            switch (*p) {
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case '"':
+                case '/':
+                case '\\': c = *p;  break;
+                case 'u':
+                    if (!(p = json_unicode(p + 1, end, &cp))) return NULL;
+                    if (cp >= 0xD800 && cp < 0xDC00 && end - p > 1 && p[0] == '\\' && p[1] == 'u') {
+                        char *next = json_unicode(p + 2, end, &low);
+                        if (next && low >= 0xDC00 && low < 0xE000) {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                            p  = next;
+                        }
+                    }
+                    if (out) *out = utf8_encode(*out, cp);
+                    p--;
+                    continue;
+                default:
+                    return NULL;
+            }
+        }
+        if (out) *(*out)++ = c;
+    }
+
+    return NULL;
+}
+
+static bool json_delimiter(char c) {
+    return c == ',' || c == ':' || c == '}' || c == ']' || c == ' ' ||
+           c == '\t' || c == '\r' || c == '\n';
+}
+
+static char *json_skip(char *p, char *end) {
+    int depth = 0;
+    do {
+        p = skip_space(p, end);
+        if (p == end) return NULL;
+        switch (*p) {
+            case '"':
+                if (!(p = json_string(p, end, NULL))) return NULL;
+                break;
+            case '{':
+            case '[':
+                depth++;
+                p++;
+                break;
+            case '}':
+            case ']':
+                depth--;
+                p++;
+                break;
+            case ',':
+            case ':':
+                if (depth == 0) return NULL;
+                p++;
+                break;
+            default:
+                while (p < end && !json_delimiter(*p)) p++;
+        }
+    } while (depth > 0);
+    return depth == 0 ? p : NULL;
+}
+
+// Iterate the members of the JSON object at p, calling fn with the raw
+// key and value of each. Returns a pointer past the object or NULL.
+static char *json_object(char *p, char *end, void (*fn)(char *, size_t, char *, void *), void *data) {
+    p = skip_space(p, end);
+    if (p == end || *p++ != '{') return NULL;
+
+    p = skip_space(p, end);
+    if (p < end && *p == '}') return p + 1;
+
+    while (p < end) {
+        char *key = p, *value;
+        if (!(p = json_string(p, end, NULL))) return NULL;
+        size_t len = p - key;
+
+        p = skip_space(p, end);
+        if (p == end || *p++ != ':') return NULL;
+
+        value = skip_space(p, end);
+        if (!(p = json_skip(value, end))) return NULL;
+        if (fn) fn(key, len, value, data);
+
+        p = skip_space(p, end);
+        if (p < end && *p == '}') return p + 1;
+        if (p == end || *p++ != ',') return NULL;
+        p = skip_space(p, end);
+    }
+
+    return NULL;
+}
+
+static void json_field(char *key, size_t len, char *value, void *data) {
+    fields *f = data;
+    if (len == 8 && !memcmp(key, "\"method\"",  8)) f->method  = value;
+    if (len == 6 && !memcmp(key, "\"path\"",    6)) f->path    = value;
+    if (len == 9 && !memcmp(key, "\"headers\"", 9)) f->headers = value;
+    if (len == 6 && !memcmp(key, "\"body\"",    6)) f->body    = value;
+}
+
+static bool json_header_valid(char *value, char *end) {
+    return *value == '"' && json_string(value, end, NULL);
+}
+
+static bool valid_json(char *p, char *end, fields *f) {
+    if (!json_object(p, end, json_field, f)) return false;
+    if (f->method  && *f->method != '"') return false;
+    if (f->path    && *f->path   != '"') return false;
+    if (f->body    && *f->body   != '"') return false;
+    if (f->headers && *f->headers != '{') return false;
+    return true;
+}
+
+static bool index_json(corpus *c, char *file) {
+    char *p = c->data, *end = c->data + c->size;
+    uint64_t line = 0;
+
+    while (p < end) {
+        char *eol = memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        line++;
+
+        if (skip_space(p, eol) < eol) {
+            fields f = { 0 };
+            if (!valid_json(p, eol, &f)) {
+                fprintf(stderr, "%s: invalid request at line %"PRIu64"\n", file, line);
+                return false;
+            }
+            add_entry(c, p - c->data, eol - p);
+        }
+
+        p = eol + 1;
+    }
+
+    return true;
+}
+
+corpus *corpus_open(char *file, char *host) {
+    corpus *c = zcalloc(sizeof(corpus));
+    struct stat st;
+    int fd;
+
+    if ((fd = open(file, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "unable to open %s: %s\n", file, strerror(errno));
+        goto error;
+    }
+
+    c->size = st.st_size;
+    c->host = zstrdup(host);
+
+    if (c->size == 0 || (c->data = mmap(NULL, c->size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "unable to map %s: %s\n", file, c->size ? strerror(errno) : "empty file");
+        c->data = NULL;
+        goto error;
+    }
+    close(fd);
+    fd = -1;
+
+    char *p = skip_space(c->data, c->data + c->size);
+    c->json = p < c->data + c->size && *p == '{';
+
+    if (!(c->json ? index_json(c, file) : index_raw(c, file))) goto error;
+
+    if (c->count == 0) {
+        fprintf(stderr, "%s: no requests found\n", file);
+        goto error;
+    }
+
+    return c;
+
+  error:
+    if (fd != -1) close(fd);
+    if (c->data) munmap(c->data, c->size);
+    zfree(c->entries);
+    zfree(c->host);
+    zfree(c);
+    return NULL;
+}
+
+uint64_t corpus_count(corpus *c) {
+    return c->count;
+}
+
+static char *append(char *o, const char *s, size_t len) {
+    memcpy(o, s, len);
+    return o + len;
+}
+
+static char *render_number(char *o, uint64_t n) {
+    char tmp[20], *c = tmp + sizeof(tmp);
+    do {
+        *--c = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    return append(o, c, tmp + sizeof(tmp) - c);
+}
+
+typedef struct {
+    char *end;
+    char *out;
+    bool  host;
+    bool  length;
+} headers;
+
+static void json_header(char *key, size_t len, char *value, void *data) {
+    headers *h = data;
+    char *name = h->out;
+
+    if (!json_header_valid(value, h->end)) return;
+
+    json_string(key, h->end, &h->out);
+    size_t n = h->out - name;
+    if (n == 4  && !strncasecmp(name, "Host", 4))            h->host   = true;
+    if (n == 14 && !strncasecmp(name, "Content-Length", 14)) h->length = true;
+
+    h->out = append(h->out, ": ", 2);
+    json_string(value, h->end, &h->out);
+    h->out = append(h->out, "\r\n", 2);
+}
+
+static void render_json(corpus *c, entry *e, char **buf, size_t *len) {
+    char *p = c->data + e->off, *end = p + e->len;
+    size_t host = strlen(c->host);
+    fields f = { 0 };
+
+    valid_json(p, end, &f);
+    *buf = realloc(*buf, e->len + host + 160);
+
+    headers h = { .end = end, .out = *buf };
+
+    if (f.method) {
+        json_string(f.method, end, &h.out);
+    } else {
+        h.out = append(h.out, "GET", 3);
+    }
+    *h.out++ = ' ';
+
+    if (f.path) {
+        json_string(f.path, end, &h.out);
+    } else {
+        *h.out++ = '/';
+    }
+    h.out = append(h.out, " HTTP/1.1\r\n", 11);
+
+    if (f.headers) json_object(f.headers, end, json_header, &h);
+
+    if (!h.host) {
+        h.out = append(h.out, "Host: ", 6);
+        h.out = append(h.out, c->host, host);
+        h.out = append(h.out, "\r\n", 2);
+    }
+
+    if (f.body) {
+        char *body = h.out + 64, *o = body;
+        json_string(f.body, end, &o);
+        size_t n = o - body;
+
+        if (!h.length) {
+            h.out = append(h.out, "Content-Length: ", 16);
+            h.out = render_number(h.out, n);
+            h.out = append(h.out, "\r\n", 2);
+        }
+        h.out = append(h.out, "\r\n", 2);
+        memmove(h.out, body, n);
+        h.out += n;
+    } else {
+        h.out = append(h.out, "\r\n", 2);
+    }
+
+    *len = h.out - *buf;
+}
+
+void corpus_request(corpus *c, uint64_t index, char **buf, size_t *len) {
+    entry *e = &c->entries[index % c->count];
+    if (c->json) {
+        render_json(c, e, buf, len);
+    } else {
+        *buf = c->data + e->off;
+        *len = e->len;
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct corpus corpus;
+
+corpus *corpus_open(char *, char *);
+uint64_t corpus_count(corpus *);
+
+void corpus_request(corpus *, uint64_t, char **, size_t *);
+
+#endif /* CORPUS_H */
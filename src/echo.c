@@ -0,0 +1,293 @@
+// Copyright (C) 2012 - Will Glozer.  All rights reserved.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "ae.h"
+#include "http_parser.h"
+#include "units.h"
+#include "zmalloc.h"
+
+#define RECVBUF     8192
+#define WRITE_BATCH 64
+
+static struct config {
+    uint64_t threads;
+    uint64_t size;
+    char    *host;
+    char    *port;
+} cfg;
+
+static struct {
+    char  *data;
+    size_t length;
+} response;
+
+typedef struct {
+    pthread_t thread;
+    aeEventLoop *loop;
+    int fd;
+} worker;
+
+typedef struct {
+    int fd;
+    http_parser parser;
+    uint64_t ready;
+    size_t offset;
+    bool close;
+} client;
+
+static void client_read(aeEventLoop *, int, void *, int);
+static void client_write(aeEventLoop *, int, void *, int);
+
+static void usage() {
+    printf("Usage: wrk-echo <options> <port>                      \n"
+           "  Options:                                            \n"
+           "    -t, --threads     <N>  Number of threads to use   \n"
+           "    -s, --size        <N>  Response body size         \n"
+           "    -b, --bind        <A>  Address to listen on       \n"
+           "                                                      \n"
+           "  Numeric arguments may include a SI unit (1k, 1M, 1G)\n");
+}
+
+static int request_complete(http_parser *parser) {
+    client *c = parser->data;
+    c->ready++;
+    if (!http_should_keep_alive(parser)) c->close = true;
+    return 0;
+}
+
+static http_parser_settings settings = {
+    .on_message_complete = request_complete
+};
+
+static void client_close(aeEventLoop *loop, client *c) {
+    aeDeleteFileEvent(loop, c->fd, AE_READABLE | AE_WRITABLE);
+    close(c->fd);
+    zfree(c);
+}
+
+static void client_read(aeEventLoop *loop, int fd, void *data, int mask) {
+    client *c = data;
+    char buf[RECVBUF];
+    ssize_t n;
+
+    if ((n = read(fd, buf, sizeof(buf))) == -1) {
+        if (errno == EAGAIN) return;
+        goto error;
+    }
+
+    if (n == 0 || http_parser_execute(&c->parser, &settings, buf, n) != (size_t) n) goto error;
+    if (c->ready) client_write(loop, fd, c, AE_WRITABLE);
+
+    return;
+
+  error:
+    client_close(loop, c);
+}
+
+static void client_write(aeEventLoop *loop, int fd, void *data, int mask) {
+    client *c = data;
+    struct iovec iov[WRITE_BATCH];
+
+    while (c->ready) {
+        size_t offset = c->offset;
+        int count = 0;
+
+        for (; count < WRITE_BATCH && (uint64_t) count < c->ready; count++) {
+            iov[count].iov_base = response.data   + offset;
+            iov[count].iov_len  = response.length - offset;
+            offset = 0;
+        }
+
+        ssize_t n = writev(fd, iov, count);
+        if (n == -1) {
+            if (errno != EAGAIN) goto error;
+            if (!(aeGetFileEvents(loop, fd) & AE_WRITABLE)) {
+                aeCreateFileEvent(loop, fd, AE_WRITABLE, client_write, c);
+            }
+            return;
+        }
+
+        n += c->offset;
+        c->ready -= n / response.length;
+        c->offset = n % response.length;
+    }
+
+    if (aeGetFileEvents(loop, fd) & AE_WRITABLE) {
+        aeDeleteFileEvent(loop, fd, AE_WRITABLE);
+    }
+    if (c->close) client_close(loop, c);
+
+    return;
+
+  error:
+    client_close(loop, c);
+}
+
+static void server_accept(aeEventLoop *loop, int fd, void *data, int mask) {
+    int cfd, flags = 1;
+
+    while ((cfd = accept(fd, NULL, NULL)) != -1) {
+        client *c = zcalloc(sizeof(client));
+        c->fd = cfd;
+        http_parser_init(&c->parser, HTTP_REQUEST);
+        c->parser.data = c;
+
+        fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL, 0) | O_NONBLOCK);
+        setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
+
+        if (aeCreateFileEvent(loop, cfd, AE_READABLE, client_read, c) == AE_ERR) {
+            close(cfd);
+            zfree(c);
+        }
+    }
+}
+
+static int server_listen(struct addrinfo *addr) {
+    int fd, flags = 1;
+
+    if ((fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) == -1) return -1;
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flags, sizeof(flags));
+#ifdef SO_REUSEPORT
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &flags, sizeof(flags));
+#endif
+
+    if (bind(fd, addr->ai_addr, addr->ai_addrlen) == -1 || listen(fd, SOMAXCONN) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+static void *worker_main(void *arg) {
+    worker *w = arg;
+    aeMain(w->loop);
+    return NULL;
+}
+
+static void build_response(uint64_t size) {
+    char header[64];
+    int len = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %"PRIu64"\r\n\r\n", size);
+
+    response.length = len + size;
+    response.data   = zmalloc(response.length);
+    memcpy(response.data, header, len);
+    memset(response.data + len, 'x', size);
+}
+
+static struct option longopts[] = {
+    { "threads", required_argument, NULL, 't' },
+    { "size",    required_argument, NULL, 's' },
+    { "bind",    required_argument, NULL, 'b' },
+    { "help",    no_argument,       NULL, 'h' },
+    { NULL,      0,                 NULL,  0  }
+};
+
+static int parse_args(struct config *cfg, int argc, char **argv) {
+    int c;
+
+    memset(cfg, 0, sizeof(struct config));
+    cfg->threads = 2;
+    cfg->size    = 13;
+
+    while ((c = getopt_long(argc, argv, "t:s:b:h?", longopts, NULL)) != -1) {
+        switch (c) {
+            case 't':
+                if (scan_metric(optarg, &cfg->threads)) return -1;
+                break;
+            case 's':
+                if (scan_metric(optarg, &cfg->size)) return -1;
+                break;
+            case 'b':
+                cfg->host = optarg;
+                break;
+            case 'h':
+            case '?':
+            case ':':
+            default:
+                return -1;
+        }
+    }
+
+    if (optind != argc - 1 || !cfg->threads) return -1;
+    cfg->port = argv[optind];
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct addrinfo *addrs, hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags    = AI_PASSIVE
+    };
+    int rc, fd = -1;
+
+    if (parse_args(&cfg, argc, argv)) {
+        usage();
+        exit(1);
+    }
+
+    if ((rc = getaddrinfo(cfg.host, cfg.port, &hints, &addrs)) != 0) {
+        fprintf(stderr, "unable to resolve %s:%s %s\n", cfg.host ? cfg.host : "*", cfg.port, gai_strerror(rc));
+        exit(1);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    build_response(cfg.size);
+
+    worker *workers = zcalloc(cfg.threads * sizeof(worker));
+
+    for (uint64_t i = 0; i < cfg.threads; i++) {
+        worker *w = &workers[i];
+
+#ifdef SO_REUSEPORT
+        fd = server_listen(addrs);
+#else
+        if (fd == -1) fd = server_listen(addrs);
+#endif
+        if (fd == -1) {
+            fprintf(stderr, "unable to listen on port %s: %s\n", cfg.port, strerror(errno));
+            exit(1);
+        }
+
+        w->fd   = fd;
+        w->loop = aeCreateEventLoop(1024);
+
+        if (!w->loop || aeCreateFileEvent(w->loop, fd, AE_READABLE, server_accept, w) == AE_ERR ||
+            pthread_create(&w->thread, NULL, &worker_main, w)) {
+            fprintf(stderr, "unable to create thread %"PRIu64": %s\n", i, strerror(errno));
+            exit(2);
+        }
+    }
+
+    freeaddrinfo(addrs);
+
+    printf("Serving %"PRIu64" byte responses on port %s with %"PRIu64" threads\n", cfg.size, cfg.port, cfg.threads);
+    fflush(stdout);
+
+    for (uint64_t i = 0; i < cfg.threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    return 0;
+}
@@ -16,8 +16,11 @@
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/un.h>
 
 #include "ssl.h"
 #include "aprintf.h"
@@ -27,17 +30,46 @@
 
 struct config;
 
+static void start_thread(thread *);
+static void run_worker(uint64_t, size_t *);
+static bool wait_worker(pid_t, uint64_t);
+static void *shared_alloc(size_t);
+static stats *alloc_stats(uint64_t);
 static void *thread_main(void *);
 static int connect_socket(thread *, connection *);
+static void close_socket(thread *, connection *);
 static int reconnect_socket(thread *, connection *);
+static int schedule_connect(thread *, connection *);
+static target_set *resolve_targets(lua_State *);
+static target *next_target();
+static void target_error(connection *);
+static char *format_addr(struct addrinfo *);
+static int connect_queued(aeEventLoop *, long long, void *);
+static void backoff_connect(thread *, connection *);
+static int retry_connect(aeEventLoop *, long long, void *);
 
+static template *compile_template(lua_State *, char *, uint64_t);
+static corpus *open_corpus(lua_State *, char *);
 static int record_rate(aeEventLoop *, long long, void *);
+static void sample_tcp_info(thread *);
+static void loop_sleep(aeEventLoop *);
+static void loop_wake(aeEventLoop *);
+static void measure_load(thread *);
+static void find_peer(thread *);
+static void hand_off(connection *);
 
 static void socket_connected(aeEventLoop *, int, void *, int);
 static void socket_writeable(aeEventLoop *, int, void *, int);
 static void socket_readable(aeEventLoop *, int, void *, int);
+static bool prepare_request(thread *, connection *);
 
+static bool sample_response(thread *);
+static step *lookup_step(const char *);
+static bool next_step(thread *, connection *, int);
 static int response_complete(http_parser *);
+static void borrow_buffer(thread *, buffer *);
+static void release_buffer(thread *, buffer *);
+static void release_buffers(connection *);
 static int header_field(http_parser *, const char *, size_t);
 static int header_value(http_parser *, const char *, size_t);
 static int response_body(http_parser *, const char *, size_t);
@@ -46,9 +78,12 @@ static uint64_t time_us();
 
 static int parse_args(struct config *, char **, struct http_parser_url *, char **, int, char **);
 static char *copy_url_part(char *, struct http_parser_url *, enum http_parser_url_fields);
+static bool parse_bind(char *, struct config *);
 
 static void print_stats_header();
 static void print_stats(char *, stats *, char *(*)(long double));
 static void print_stats_latency(stats *);
+static void print_stats_steps();
+static void print_stats_targets();
 
 #endif /* MAIN_H */
@@ -2,6 +2,13 @@
 
 #include <errno.h>
 #include <unistd.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#ifdef __linux__
+#include <linux/tcp.h>
+#else
+#include <netinet/tcp.h>
+#endif
 #include <sys/ioctl.h>
 
 #include "net.h"
@@ -15,7 +22,7 @@ status sock_close(connection *c) {
 }
 
 status sock_read(connection *c, size_t *n) {
-    ssize_t r = read(c->fd, c->buf, sizeof(c->buf));
+    ssize_t r = read(c->fd, c->thread->buf, sizeof(c->thread->buf));
     *n = (size_t) r;
     return r >= 0 ? OK : ERROR;
 }
@@ -24,8 +31,9 @@ status sock_write(connection *c, char *buf, size_t len, size_t *n) {
     ssize_t r;
     if ((r = write(c->fd, buf, len)) == -1) {
         switch (errno) {
-            case EAGAIN: return RETRY;
-            default:     return ERROR;
+            case EAGAIN:      return RETRY;
+            case EINPROGRESS: return RETRY;
+            default:          return ERROR;
         }
     }
     *n = (size_t) r;
@@ -37,3 +45,35 @@ size_t sock_readable(connection *c) {
     rc = ioctl(c->fd, FIONREAD, &n);
     return rc == -1 ? 0 : n;
 }
+
+bool sock_syn_data(connection *c) {
+#ifdef TCPI_OPT_SYN_DATA
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(c->fd, IPPROTO_TCP, TCP_INFO, &info, &len)) return false;
+    return info.tcpi_options & TCPI_OPT_SYN_DATA;
+#else
+    return false;
+#endif
+}
+
+bool sock_tcp_info(connection *c, tcp_sample *sample) {
+#ifdef TCP_INFO
+    struct tcp_info info = { 0 };
+    socklen_t len = sizeof(info);
+    if (getsockopt(c->fd, IPPROTO_TCP, TCP_INFO, &info, &len)) return false;
+
+    sample->rtt     = info.tcpi_rtt;
+    sample->retrans = info.tcpi_total_retrans;
+    sample->cwnd    = info.tcpi_snd_cwnd;
+    sample->rwnd_limited = 0;
+#ifdef __linux__
+    if (len >= offsetof(struct tcp_info, tcpi_rwnd_limited) + sizeof(info.tcpi_rwnd_limited) && info.tcpi_busy_time) {
+        sample->rwnd_limited = info.tcpi_rwnd_limited * 100 / info.tcpi_busy_time;
+    }
+#endif
+    return true;
+#else
+    return false;
+#endif
+}
@@ -12,6 +12,13 @@ typedef enum {
     RETRY
 } status;
 
+typedef struct {
+    uint64_t rtt;
+    uint64_t retrans;
+    uint64_t rwnd_limited;
+    uint64_t cwnd;
+} tcp_sample;
+
 struct sock {
     status ( *connect)(connection *, char *);
     status (   *close)(connection *);
@@ -25,5 +32,7 @@ status sock_close(connection *);
 status sock_read(connection *, size_t *);
 status sock_write(connection *, char *, size_t, size_t *);
 size_t sock_readable(connection *);
+bool sock_syn_data(connection *);
+bool sock_tcp_info(connection *, tcp_sample *);
 
 #endif /* NET_H */
@@ -2,6 +2,8 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/un.h>
 #include "script.h"
 #include "http_parser.h"
 #include "zmalloc.h"
@@ -14,6 +16,9 @@ typedef struct {
 
 static int script_addr_tostring(lua_State *);
 static int script_addr_gc(lua_State *);
+static int script_headers_call(lua_State *);
+static int script_headers_index(lua_State *);
+static int script_headers_len(lua_State *);
 static int script_stats_call(lua_State *);
 static int script_stats_len(lua_State *);
 static int script_stats_index(lua_State *);
@@ -21,6 +26,7 @@ static int script_thread_index(lua_State *);
 static int script_thread_newindex(lua_State *);
 static int script_wrk_lookup(lua_State *);
 static int script_wrk_connect(lua_State *);
+static struct addrinfo *checkaddr(lua_State *);
 
 static void set_fields(lua_State *, int, const table_field *);
 static void set_field(lua_State *, int, char *, int);
@@ -32,6 +38,13 @@ static const struct luaL_reg addrlib[] = {
     { NULL,         NULL                   }
 };
 
+static const struct luaL_reg headerslib[] = {
+    { "__call",     script_headers_call    },
+    { "__index",    script_headers_index   },
+    { "__len",      script_headers_len     },
+    { NULL,         NULL                   }
+};
+
 static const struct luaL_reg statslib[] = {
     { "__call",     script_stats_call      },
     { "__index",    script_stats_index     },
@@ -52,6 +65,8 @@ lua_State *script_create(char *file, char *url, char **headers) {
 
     luaL_newmetatable(L, "wrk.addr");
     luaL_register(L, NULL, addrlib);
+    luaL_newmetatable(L, "wrk.headers");
+    luaL_register(L, NULL, headerslib);
     luaL_newmetatable(L, "wrk.stats");
     luaL_register(L, NULL, statslib);
     luaL_newmetatable(L, "wrk.thread");
@@ -74,21 +89,32 @@ lua_State *script_create(char *file, char *url, char **headers) {
 
     lua_getglobal(L, "wrk");
 
-    set_field(L, 4, "scheme", push_url_part(L, url, &parts, UF_SCHEMA));
-    set_field(L, 4, "host",   push_url_part(L, url, &parts, UF_HOST));
-    set_field(L, 4, "port",   push_url_part(L, url, &parts, UF_PORT));
-    set_fields(L, 4, fields);
+    set_field(L, 5, "scheme", push_url_part(L, url, &parts, UF_SCHEMA));
+    set_field(L, 5, "host",   push_url_part(L, url, &parts, UF_HOST));
+    set_field(L, 5, "port",   push_url_part(L, url, &parts, UF_PORT));
+    set_fields(L, 5, fields);
 
-    lua_getfield(L, 4, "headers");
+    if (!strncmp(url, "unix://", 7)) {
+        lua_pushstring(L, "localhost");
+        lua_setfield(L, 5, "host");
+    }
+
+    lua_getfield(L, 5, "headers");
     for (char **h = headers; *h; h++) {
         char *p = strchr(*h, ':');
         if (p && p[1] == ' ') {
             lua_pushlstring(L, *h, p - *h);
             lua_pushstring(L, p + 2);
-            lua_settable(L, 5);
+            lua_settable(L, 6);
         }
     }
-    lua_pop(L, 5);
+    lua_pop(L, 6);
+
+    buffer **ptr = (buffer **) lua_newuserdata(L, sizeof(buffer **));
+    *ptr = NULL;
+    luaL_getmetatable(L, "wrk.headers");
+    lua_setmetatable(L, -2);
+    lua_setfield(L, LUA_REGISTRYINDEX, "wrk.response.headers");
 
     if (file && luaL_dofile(L, file)) {
         const char *cause = lua_tostring(L, -1);
@@ -104,7 +130,13 @@ bool script_resolve(lua_State *L, char *host, char *service) {
     lua_getfield(L, -1, "resolve");
     lua_pushstring(L, host);
     lua_pushstring(L, service);
-    lua_call(L, 2, 0);
+    if (lua_pcall(L, 2, 0, 0)) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        lua_getfield(L, -2, "addrs");
+        if (lua_isnil(L, -1)) exit(1);
+        lua_pop(L, 3);
+        return false;
+    }
 
     lua_getfield(L, -1, "addrs");
     size_t count = lua_objlen(L, -1);
@@ -112,6 +144,23 @@ bool script_resolve(lua_State *L, char *host, char *service) {
     return count > 0;
 }
 
+struct addrinfo *script_addrs(lua_State *L, uint64_t *count) {
+    lua_getglobal(L, "wrk");
+    lua_getfield(L, -1, "addrs");
+
+    *count = lua_objlen(L, -1);
+    struct addrinfo *addrs = zcalloc(*count * sizeof(struct addrinfo));
+
+    for (uint64_t i = 0; i < *count; i++) {
+        lua_rawgeti(L, -1, i + 1);
+        script_addr_copy(checkaddr(L), &addrs[i]);
+        lua_pop(L, 1);
+    }
+
+    lua_pop(L, 2);
+    return addrs;
+}
+
 void script_push_thread(lua_State *L, thread *t) {
     thread **ptr = (thread **) lua_newuserdata(L, sizeof(thread **));
     *ptr = t;
@@ -164,22 +213,106 @@ void script_request(lua_State *L, char **buf, size_t *len) {
     lua_pop(L, pop);
 }
 
+void script_format(lua_State *L, char *method, char *path, char **buf, size_t *len) {
+    lua_getglobal(L, "wrk");
+    lua_getfield(L, -1, "format");
+    lua_pushstring(L, method);
+    lua_pushstring(L, path);
+    lua_call(L, 2, 1);
+    const char *str = lua_tolstring(L, -1, len);
+    *buf = realloc(*buf, *len);
+    memcpy(*buf, str, *len);
+    lua_pop(L, 2);
+}
+
 void script_response(lua_State *L, int status, buffer *headers, buffer *body) {
     lua_getglobal(L, "response");
     lua_pushinteger(L, status);
-    lua_newtable(L);
+    lua_getfield(L, LUA_REGISTRYINDEX, "wrk.response.headers");
 
-    for (char *c = headers->buffer; c < headers->cursor; ) {
-        c = buffer_pushlstring(L, c);
-        c = buffer_pushlstring(L, c);
-        lua_rawset(L, -3);
+    buffer **ptr = lua_touserdata(L, -1);
+    *ptr = headers;
+
+    if (body) {
+        lua_pushlstring(L, body->buffer, body->cursor - body->buffer);
     }
+    lua_call(L, body ? 3 : 2, 0);
 
-    lua_pushlstring(L, body->buffer, body->cursor - body->buffer);
-    lua_call(L, 3, 0);
+    *ptr = NULL;
+}
+
+const char *script_step(lua_State *L, connection *c, int status, const char **cause) {
+    lua_State *co = c->co;
+    buffer **ptr = NULL;
+    int narg = 0, rc;
+
+    if (co && status) {
+        lua_settop(co, 0);
+        lua_pushinteger(co, status);
+        lua_getfield(co, LUA_REGISTRYINDEX, "wrk.response.headers");
+        ptr = lua_touserdata(co, -1);
+        *ptr = &c->headers;
+        lua_pushlstring(co, c->body.buffer, c->body.cursor - c->body.buffer);
+        narg = 3;
+    }
+
+    for (bool fresh = false; ; ) {
+        if (!co || lua_status(co) != LUA_YIELD) {
+            if (co) luaL_unref(L, LUA_REGISTRYINDEX, c->ref);
+            co = c->co = lua_newthread(L);
+            c->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+            lua_getglobal(co, "scenario");
+            narg  = 0;
+            fresh = true;
+        }
+
+        rc = lua_resume(co, narg);
+        if (ptr) *ptr = NULL;
+        if (rc != 0) break;
+
+        if (fresh) {
+            lua_pushstring(co, "scenario() returned without yielding a request");
+            break;
+        }
+    }
+
+    const char *name = lua_tostring(co, 1);
+    size_t len;
+    const char *str = lua_tolstring(co, 2, &len);
+
+    if (rc != LUA_YIELD || !str) {
+        *cause = rc != LUA_YIELD ? lua_tostring(co, -1) : "no request yielded";
+        return NULL;
+    }
+
+    c->request = realloc(c->request, len);
+    c->length  = len;
+    memcpy(c->request, str, len);
+
+    return name ? name : "scenario";
+}
+
+char *script_header(lua_State *L, char *name) {
+    lua_getglobal(L, "wrk");
+    lua_getfield(L, -1, "headers");
+    lua_getfield(L, -1, name);
+    const char *value = lua_tostring(L, -1);
+    char *copy = value ? zstrdup(value) : NULL;
+    lua_pop(L, 3);
+    return copy;
+}
 
-    buffer_reset(headers);
-    buffer_reset(body);
+uint64_t script_response_sample(lua_State *L) {
+    lua_getglobal(L, "wrk");
+    lua_getfield(L, -1, "response_sample_rate");
+    bool set = !lua_isnil(L, -1);
+    lua_Number rate = lua_tonumber(L, -1);
+    lua_pop(L, 2);
+    if (set && !(rate >= 1)) {
+        fprintf(stderr, "wrk.response_sample_rate must be a number of at least 1\n");
+        exit(1);
+    }
+    return set ? (uint64_t) rate : 1;
 }
 
 bool script_is_function(lua_State *L, char *name) {
@@ -197,6 +330,23 @@ bool script_want_response(lua_State *L) {
     return script_is_function(L, "response");
 }
 
+bool script_want_body(lua_State *L) {
+    lua_getglobal(L, "debug");
+    lua_getfield(L, -1, "getinfo");
+    lua_getglobal(L, "response");
+    lua_pushstring(L, "u");
+    lua_call(L, 2, 1);
+    lua_getfield(L, -1, "nparams");
+    lua_getfield(L, -2, "isvararg");
+    bool want_body = lua_isnil(L, -2) || lua_tointeger(L, -2) > 2 || lua_toboolean(L, -1);
+    lua_pop(L, 4);
+    return want_body;
+}
+
+bool script_has_scenario(lua_State *L) {
+    return script_is_function(L, "scenario");
+}
+
 bool script_has_delay(lua_State *L) {
     return script_is_function(L, "delay");
 }
@@ -226,7 +376,9 @@ void script_errors(lua_State *L, errors *errors) {
         errors->read,
         errors->write,
         errors->status,
-        errors->timeout
+        errors->timeout,
+        errors->close,
+        errors->scenario
     };
     const table_field fields[] = {
         { "connect", LUA_TNUMBER, &e[0] },
@@ -234,7 +386,9 @@ void script_errors(lua_State *L, errors *errors) {
         { "write",   LUA_TNUMBER, &e[2] },
         { "status",  LUA_TNUMBER, &e[3] },
         { "timeout", LUA_TNUMBER, &e[4] },
-        { NULL,      0,           NULL  },
+        { "close",    LUA_TNUMBER, &e[5] },
+        { "scenario", LUA_TNUMBER, &e[6] },
+        { NULL,       0,           NULL  },
     };
     lua_newtable(L);
     set_fields(L, 2, fields);
@@ -248,6 +402,57 @@ void script_push_stats(lua_State *L, stats *s) {
     lua_setmetatable(L, -2);
 }
 
+void script_tcp(lua_State *L, stats *rtt, stats *retrans, stats *rwnd, stats *cwnd) {
+    lua_newtable(L);
+    script_push_stats(L, rtt);
+    lua_setfield(L, -2, "rtt");
+    script_push_stats(L, retrans);
+    lua_setfield(L, -2, "retransmits");
+    script_push_stats(L, rwnd);
+    lua_setfield(L, -2, "rwnd_limited");
+    script_push_stats(L, cwnd);
+    lua_setfield(L, -2, "cwnd");
+    lua_setfield(L, 1, "tcp");
+}
+
+void script_targets(lua_State *L, target **targets, uint64_t count) {
+    lua_newtable(L);
+    for (uint64_t i = 0; i < count; i++) {
+        target *t = targets[i];
+        const table_field fields[] = {
+            { "addr",     LUA_TSTRING, t->name      },
+            { "requests", LUA_TNUMBER, &t->requests },
+            { "errors",   LUA_TNUMBER, &t->errors   },
+            { NULL,       0,           NULL         },
+        };
+        lua_newtable(L);
+        set_fields(L, lua_gettop(L), fields);
+        script_push_stats(L, t->latency);
+        lua_setfield(L, -2, "latency");
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, 1, "addrs");
+}
+
+void script_load(lua_State *L, thread *threads, uint64_t count, stats *lag) {
+    lua_newtable(L);
+    for (uint64_t i = 0; i < count; i++) {
+        thread *t = &threads[i];
+        const table_field fields[] = {
+            { "busy", LUA_TNUMBER, &t->busy_us },
+            { "lua",  LUA_TNUMBER, &t->lua_us  },
+            { "lag",  LUA_TNUMBER, &t->lag_max },
+            { NULL,   0,           NULL        },
+        };
+        lua_newtable(L);
+        set_fields(L, lua_gettop(L), fields);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, 1, "threads");
+    script_push_stats(L, lag);
+    lua_setfield(L, 1, "lag");
+}
+
 void script_done(lua_State *L, stats *latency, stats *requests) {
     lua_getglobal(L, "done");
     lua_pushvalue(L, 1);
@@ -325,6 +530,11 @@ static int script_addr_tostring(lua_State *L) {
     char host[NI_MAXHOST];
     char service[NI_MAXSERV];
 
+    if (addr->ai_family == AF_UNIX) {
+        lua_pushfstring(L, "unix:%s", ((struct sockaddr_un *) addr->ai_addr)->sun_path);
+        return 1;
+    }
+
     int flags = NI_NUMERICHOST | NI_NUMERICSERV;
     int rc = getnameinfo(addr->ai_addr, addr->ai_addrlen, host, NI_MAXHOST, service, NI_MAXSERV, flags);
     if (rc != 0) {
@@ -383,6 +593,52 @@ static int script_stats_len(lua_State *L) {
     return 1;
 }
 
+static buffer *checkheaders(lua_State *L) {
+    buffer **b = luaL_checkudata(L, 1, "wrk.headers");
+    luaL_argcheck(L, b != NULL, 1, "`headers' expected");
+    return *b;
+}
+
+static int script_headers_call(lua_State *L) {
+    buffer *b = checkheaders(L);
+    lua_Integer index = lua_tointeger(L, 2);
+    for (char *c = b ? b->buffer : NULL; c && c < b->cursor; index--) {
+        char *value = strchr(c, 0) + 1;
+        if (index == 1) {
+            buffer_pushlstring(L, c);
+            buffer_pushlstring(L, value);
+            return 2;
+        }
+        c = strchr(value, 0) + 1;
+    }
+    return 0;
+}
+
+static int script_headers_index(lua_State *L) {
+    buffer *b = checkheaders(L);
+    const char *name = lua_tostring(L, 2);
+    for (char *c = b ? b->buffer : NULL; c && name && c < b->cursor; ) {
+        char *value = strchr(c, 0) + 1;
+        if (!strcasecmp(c, name)) {
+            buffer_pushlstring(L, value);
+            return 1;
+        }
+        c = strchr(value, 0) + 1;
+    }
+    lua_pushnil(L);
+    return 1;
+}
+
+static int script_headers_len(lua_State *L) {
+    buffer *b = checkheaders(L);
+    lua_Integer count = 0;
+    for (char *c = b ? b->buffer : NULL; c && c < b->cursor; count++) {
+        c = strchr(strchr(c, 0) + 1, 0) + 1;
+    }
+    lua_pushinteger(L, count);
+    return 1;
+}
+
 static thread *checkthread(lua_State *L) {
     thread **t = luaL_checkudata(L, 1, "wrk.thread");
     luaL_argcheck(L, t != NULL, 1, "`thread' expected");
@@ -447,10 +703,31 @@ static int script_wrk_lookup(lua_State *L) {
     const char *host    = lua_tostring(L, -2);
     const char *service = lua_tostring(L, -1);
 
+    if (*host == '/') {
+        struct sockaddr_un un = { .sun_family = AF_UNIX };
+        struct addrinfo addr = {
+            .ai_family   = AF_UNIX,
+            .ai_socktype = SOCK_STREAM,
+            .ai_addr     = (struct sockaddr *) &un,
+            .ai_addrlen  = sizeof(un)
+        };
+
+        if (strlen(host) >= sizeof(un.sun_path)) {
+            fprintf(stderr, "unix socket path too long: %s\n", host);
+            exit(1);
+        }
+        strcpy(un.sun_path, host);
+
+        lua_newtable(L);
+        script_addr_clone(L, &addr);
+        lua_rawseti(L, -2, index);
+        return 1;
+    }
+
     if ((rc = getaddrinfo(host, service, &hints, &addrs)) != 0) {
         const char *msg = gai_strerror(rc);
-        fprintf(stderr, "unable to resolve %s:%s %s\n", host, service, msg);
-        exit(1);
+        lua_pushfstring(L, "unable to resolve %s:%s %s", host, service, msg);
+        return lua_error(L);
     }
 
     lua_newtable(L);
@@ -504,7 +781,31 @@ void script_copy_value(lua_State *src, lua_State *dst, int index) {
     }
 }
 
+static int parse_unix_url(char *url, struct http_parser_url *parts) {
+    char *path = url + 7;
+    char *sep  = strstr(path, ":/");
+    size_t len = sep ? (size_t) (sep - path) : strlen(path);
+
+    if (*path != '/' || len < 2) return 0;
+
+    memset(parts, 0, sizeof(*parts));
+    parts->field_set = (1 << UF_SCHEMA) | (1 << UF_HOST);
+    parts->field_data[UF_SCHEMA].off = 0;
+    parts->field_data[UF_SCHEMA].len = 4;
+    parts->field_data[UF_HOST].off   = path - url;
+    parts->field_data[UF_HOST].len   = len;
+
+    if (sep) {
+        parts->field_set |= (1 << UF_PATH);
+        parts->field_data[UF_PATH].off = sep + 1 - url;
+        parts->field_data[UF_PATH].len = strlen(sep + 1);
+    }
+
+    return 1;
+}
+
 int script_parse_url(char *url, struct http_parser_url *parts) {
+    if (!strncmp(url, "unix://", 7)) return parse_unix_url(url, parts);
     if (!http_parser_parse_url(url, strlen(url), 0, parts)) {
         if (!(parts->field_set & (1 << UF_SCHEMA))) return 0;
         if (!(parts->field_set & (1 << UF_HOST)))   return 0;
@@ -556,10 +857,12 @@ static void set_fields(lua_State *L, int index, const table_field *fields) {
 
 void buffer_append(buffer *b, const char *data, size_t len) {
     size_t used = b->cursor - b->buffer;
-    while (used + len + 1 >= b->length) {
-        b->length += 1024;
-        b->buffer  = realloc(b->buffer, b->length);
-        b->cursor  = b->buffer + used;
+    if (used + len + 1 >= b->length) {
+        size_t length = b->length ? b->length : 1024;
+        while (used + len + 1 >= length) length *= 2;
+        b->length = length;
+        b->buffer = realloc(b->buffer, b->length);
+        b->cursor = b->buffer + used;
     }
     memcpy(b->cursor, data, len);
     b->cursor += len;
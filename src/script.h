@@ -12,23 +12,34 @@
 lua_State *script_create(char *, char *, char **);
 
 bool script_resolve(lua_State *, char *, char *);
+struct addrinfo *script_addrs(lua_State *, uint64_t *);
 void script_setup(lua_State *, thread *);
 void script_done(lua_State *, stats *, stats *);
 
 void script_init(lua_State *, thread *, int, char **);
 uint64_t script_delay(lua_State *);
 void script_request(lua_State *, char **, size_t *);
+void script_format(lua_State *, char *, char *, char **, size_t *);
 void script_response(lua_State *, int, buffer *, buffer *);
+const char *script_step(lua_State *, connection *, int, const char **);
 size_t script_verify_request(lua_State *L);
+uint64_t script_response_sample(lua_State *);
+char *script_header(lua_State *, char *);
 
 bool script_is_static(lua_State *);
 bool script_want_response(lua_State *L);
+bool script_want_body(lua_State *L);
+bool script_has_scenario(lua_State *L);
 bool script_has_delay(lua_State *L);
 bool script_has_done(lua_State *L);
 void script_summary(lua_State *, uint64_t, uint64_t, uint64_t);
 void script_errors(lua_State *, errors *);
+void script_tcp(lua_State *, stats *, stats *, stats *, stats *);
+void script_targets(lua_State *, target **, uint64_t);
+void script_load(lua_State *, thread *, uint64_t, stats *);
 
 void script_copy_value(lua_State *, lua_State *, int);
+void script_addr_copy(struct addrinfo *, struct addrinfo *);
 int script_parse_url(char *, struct http_parser_url *);
 
 void buffer_append(buffer *, const char *, size_t);
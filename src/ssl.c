@@ -1,57 +1,102 @@
 // Copyright (C) 2013 - Will Glozer.  All rights reserved.
 
-#include <pthread.h>
-
+#include <string.h>
 #include <openssl/evp.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 
 #include "ssl.h"
+#include "zmalloc.h"
 
-static pthread_mutex_t *locks;
-
-static void ssl_lock(int mode, int n, const char *file, int line) {
-    pthread_mutex_t *lock = &locks[n];
-    if (mode & CRYPTO_LOCK) {
-        pthread_mutex_lock(lock);
-    } else {
-        pthread_mutex_unlock(lock);
-    }
+static int ssl_new_session(SSL *ssl, SSL_SESSION *session) {
+    connection *c = SSL_get_app_data(ssl);
+    if (c->session) SSL_SESSION_free(c->session);
+    c->session = session;
+    return 1;
 }
 
-static unsigned long ssl_id() {
-    return (unsigned long) pthread_self();
-}
+// TLS 1.3 suites are named TLS_*, everything else in the list applies to
+// earlier versions. Versions without any names in the list are disabled.
 
-SSL_CTX *ssl_init() {
-    SSL_CTX *ctx = NULL;
+static bool ssl_set_ciphers(SSL_CTX *ctx, char *ciphers) {
+    size_t len = strlen(ciphers) + 1;
+    char *copy = zstrdup(ciphers), *name, *last;
+    char tls12[len], tls13[len];
+    bool ok;
 
-    SSL_load_error_strings();
-    SSL_library_init();
-    OpenSSL_add_all_algorithms();
+    *tls12 = *tls13 = '\0';
+    for (name = strtok_r(copy, ":", &last); name; name = strtok_r(NULL, ":", &last)) {
+        char *list = strncmp(name, "TLS_", 4) ? tls12 : tls13;
+        if (*list) strcat(list, ":");
+        strcat(list, name);
+    }
+    zfree(copy);
 
-    if ((locks = calloc(CRYPTO_num_locks(), sizeof(pthread_mutex_t)))) {
-        for (int i = 0; i < CRYPTO_num_locks(); i++) {
-            pthread_mutex_init(&locks[i], NULL);
-        }
+    if (!*tls12 && !*tls13) return false;
 
-        CRYPTO_set_locking_callback(ssl_lock);
-        CRYPTO_set_id_callback(ssl_id);
+#ifdef TLS1_3_VERSION
+    if (*tls12) {
+        ok = SSL_CTX_set_cipher_list(ctx, tls12);
+    } else {
+        ok = SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+    }
+    if (ok && *tls13) {
+        ok = SSL_CTX_set_ciphersuites(ctx, tls13);
+    } else if (ok) {
+        ok = SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    }
+#else
+    ok = !*tls13 && SSL_CTX_set_cipher_list(ctx, tls12);
+#endif
 
-        if ((ctx = SSL_CTX_new(SSLv23_client_method()))) {
-            SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
-            SSL_CTX_set_verify_depth(ctx, 0);
-            SSL_CTX_set_mode(ctx, SSL_MODE_AUTO_RETRY);
-            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT);
-        }
+    return ok;
+}
+
+SSL_CTX *ssl_init(tls_resume resume, char *ciphers, char *groups, bool ktls, bool lowmem) {
+    SSL_CTX *ctx;
+
+    if (!OPENSSL_init_ssl(OPENSSL_INIT_LOAD_SSL_STRINGS | OPENSSL_INIT_LOAD_CRYPTO_STRINGS, NULL)) return NULL;
+    if (!(ctx = SSL_CTX_new(TLS_client_method()))) return NULL;
+
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+    SSL_CTX_set_verify_depth(ctx, 0);
+    SSL_CTX_set_mode(ctx, SSL_MODE_AUTO_RETRY);
+    if (lowmem) SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+#ifdef SSL_OP_ENABLE_KTLS
+    if (ktls) SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+    if (ciphers && !ssl_set_ciphers(ctx, ciphers)) goto error;
+
+    if (groups && !SSL_CTX_set1_groups_list(ctx, groups)) goto error;
+
+    switch (resume) {
+        case RESUME_NONE:
+            SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+            break;
+        case RESUME_ID:
+            SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+#ifdef SSL_OP_NO_TLSv1_3
+            SSL_CTX_set_options(ctx, SSL_OP_NO_TLSv1_3);
+#endif
+        case RESUME_TICKET:
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(ctx, ssl_new_session);
+            break;
     }
 
     return ctx;
+
+  error:
+    SSL_CTX_free(ctx);
+    return NULL;
 }
 
 status ssl_connect(connection *c, char *host) {
     int r;
     SSL_set_fd(c->ssl, c->fd);
+    SSL_set_app_data(c->ssl, c);
     SSL_set_tlsext_host_name(c->ssl, host);
     if ((r = SSL_connect(c->ssl)) != 1) {
         switch (SSL_get_error(c->ssl, r)) {
@@ -65,13 +110,56 @@ status ssl_connect(connection *c, char *host) {
 
 status ssl_close(connection *c) {
     SSL_shutdown(c->ssl);
-    SSL_clear(c->ssl);
+    if (c->early || SSL_get_early_data_status(c->ssl) != SSL_EARLY_DATA_NOT_SENT) {
+        // SSL_clear doesn't reset the early data state
+        SSL_CTX *ctx = SSL_get_SSL_CTX(c->ssl);
+        SSL_free(c->ssl);
+        c->ssl = SSL_new(ctx);
+    } else {
+        SSL_clear(c->ssl);
+    }
+    SSL_set_session(c->ssl, c->session);
+    return OK;
+}
+
+bool ssl_resumed(connection *c) {
+    return SSL_session_reused(c->ssl);
+}
+
+bool ssl_early_capable(connection *c) {
+    return c->session && SSL_SESSION_get_max_early_data(c->session) > 0;
+}
+
+status ssl_write_early(connection *c, char *host, char *buf, size_t len, size_t *n) {
+    SSL_set_fd(c->ssl, c->fd);
+    SSL_set_app_data(c->ssl, c);
+    SSL_set_tlsext_host_name(c->ssl, host);
+    if (!SSL_write_early_data(c->ssl, buf, len, n)) {
+        switch (SSL_get_error(c->ssl, 0)) {
+            case SSL_ERROR_WANT_READ:  return RETRY;
+            case SSL_ERROR_WANT_WRITE: return RETRY;
+            default:                   return ERROR;
+        }
+    }
     return OK;
 }
 
+bool ssl_early_accepted(connection *c) {
+    return SSL_get_early_data_status(c->ssl) == SSL_EARLY_DATA_ACCEPTED;
+}
+
+int ssl_ktls(connection *c) {
+    int ktls = 0;
+#ifdef SSL_OP_ENABLE_KTLS
+    if (BIO_get_ktls_send(SSL_get_wbio(c->ssl))) ktls |= KTLS_SEND;
+    if (BIO_get_ktls_recv(SSL_get_rbio(c->ssl))) ktls |= KTLS_RECV;
+#endif
+    return ktls;
+}
+
 status ssl_read(connection *c, size_t *n) {
     int r;
-    if ((r = SSL_read(c->ssl, c->buf, sizeof(c->buf))) <= 0) {
+    if ((r = SSL_read(c->ssl, c->thread->buf, sizeof(c->thread->buf))) <= 0) {
         switch (SSL_get_error(c->ssl, r)) {
             case SSL_ERROR_WANT_READ:  return RETRY;
             case SSL_ERROR_WANT_WRITE: return RETRY;
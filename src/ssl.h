@@ -3,12 +3,26 @@
 
 #include "net.h"
 
-SSL_CTX *ssl_init();
+typedef enum {
+    RESUME_NONE,
+    RESUME_TICKET,
+    RESUME_ID
+} tls_resume;
+
+#define KTLS_SEND 1
+#define KTLS_RECV 2
+
+SSL_CTX *ssl_init(tls_resume, char *, char *, bool, bool);
 
 status ssl_connect(connection *, char *);
 status ssl_close(connection *);
 status ssl_read(connection *, size_t *);
 status ssl_write(connection *, char *, size_t, size_t *);
 size_t ssl_readable(connection *);
+bool ssl_resumed(connection *);
+bool ssl_early_capable(connection *);
+status ssl_write_early(connection *, char *, char *, size_t, size_t *);
+bool ssl_early_accepted(connection *);
+int ssl_ktls(connection *);
 
 #endif /* SSL_H */
@@ -3,6 +3,7 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include <math.h>
+#include <sys/mman.h>
 
 #include "stats.h"
 #include "zmalloc.h"
@@ -15,6 +16,16 @@ stats *stats_alloc(uint64_t max) {
     return s;
 }
 
+stats *stats_alloc_shared(uint64_t max) {
+    uint64_t limit = max + 1;
+    size_t size = sizeof(stats) + sizeof(uint64_t) * limit;
+    stats *s = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (s == MAP_FAILED) return NULL;
+    s->limit = limit;
+    s->min   = UINT64_MAX;
+    return s;
+}
+
 void stats_free(stats *stats) {
     zfree(stats);
 }
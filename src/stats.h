@@ -13,6 +13,8 @@ typedef struct {
     uint32_t write;
     uint32_t status;
     uint32_t timeout;
+    uint32_t close;
+    uint32_t scenario;
 } errors;
 
 typedef struct {
@@ -24,6 +26,7 @@ typedef struct {
 } stats;
 
 stats *stats_alloc(uint64_t);
+stats *stats_alloc_shared(uint64_t);
 void stats_free(stats *);
 
 int stats_record(stats *, uint64_t);
@@ -0,0 +1,260 @@
+// Copyright (C) 2012 - Will Glozer.  All rights reserved.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "template.h"
+#include "zmalloc.h"
+
+#define NUMBER_MAX 20
+
+typedef enum {
+    LITERAL,
+    SEQ,
+    RAND,
+    LIST,
+    LENGTH
+} segment_type;
+
+typedef struct segment {
+    segment_type type;
+    char    *str;
+    size_t   len;
+    uint64_t min;
+    uint64_t max;
+    size_t   count;
+    struct segment *items;
+} segment;
+
+struct template {
+    char    *source;
+    segment *segments;
+    size_t   count;
+    size_t   body;
+    size_t   size;
+    bool     length;
+    uint64_t seq;
+    uint64_t rng;
+    char    *scratch;
+};
+
+static char *search(char *c, char *end, const char *pat) {
+    size_t len = strlen(pat);
+    for (; c + len <= end; c++) {
+        if (*c == *pat && !memcmp(c, pat, len)) return c;
+    }
+    return NULL;
+}
+
+static segment *add_segment(template *t, segment_type type) {
+    t->segments = zrealloc(t->segments, (t->count + 1) * sizeof(segment));
+    segment *s = &t->segments[t->count++];
+    memset(s, 0, sizeof(segment));
+    s->type = type;
+    return s;
+}
+
+static void add_literal(template *t, char *str, size_t len) {
+    if (len == 0) return;
+    segment *s = add_segment(t, LITERAL);
+    s->str = str;
+    s->len = len;
+}
+
+static bool scan_number(char *s, char **end, uint64_t *n) {
+    if (*s < '0' || *s > '9') return false;
+    *n = strtoull(s, end, 10);
+    return true;
+}
+
+static bool add_slot(template *t, char *start, char *end) {
+    size_t len = end - start;
+    char *arg = zmalloc(len + 1), *c;
+    memcpy(arg, start, len);
+    arg[len] = '\0';
+
+    if (!strcmp(arg, "seq")) {
+        add_segment(t, SEQ);
+    } else if (!strncmp(arg, "rand:", 5)) {
+        segment *s = add_segment(t, RAND);
+        if (!scan_number(arg + 5, &c, &s->min) || *c != ':') goto error;
+        if (!scan_number(c + 1, &c, &s->max) || *c != '\0') goto error;
+        if (s->min > s->max) goto error;
+    } else if (!strncmp(arg, "list:", 5) && arg[5]) {
+        segment *s = add_segment(t, LIST);
+        s->str = arg;
+        for (c = arg + 5; c; s->count++) {
+            char *item = c;
+            if ((c = strchr(c, ','))) *c++ = '\0';
+            s->items = zrealloc(s->items, (s->count + 1) * sizeof(segment));
+            s->items[s->count].str = item;
+            s->items[s->count].len = strlen(item);
+            if (s->len < strlen(item)) s->len = strlen(item);
+        }
+        return true;
+    } else {
+        goto error;
+    }
+
+    zfree(arg);
+    return true;
+
+  error:
+    zfree(arg);
+    return false;
+}
+
+static bool parse(template *t, char *c, char *end) {
+    while (c < end) {
+        char *open  = search(c, end, "{{");
+        char *close = open ? search(open + 2, end, "}}") : NULL;
+
+        if (!close) {
+            add_literal(t, c, end - c);
+            break;
+        }
+
+        add_literal(t, c, open - c);
+        if (!add_slot(t, open + 2, close)) {
+            fprintf(stderr, "invalid template placeholder: %.*s\n", (int) (close + 2 - open), open);
+            return false;
+        }
+        c = close + 2;
+    }
+    return true;
+}
+
+static size_t segments_size(segment *s, segment *end) {
+    size_t size = 0;
+    for (; s < end; s++) {
+        size += s->type == LITERAL || s->type == LIST ? s->len : NUMBER_MAX;
+    }
+    return size;
+}
+
+template *template_compile(char *src, size_t len, uint64_t seed) {
+    template *t = zcalloc(sizeof(template));
+    char *end, *body, *open, *length;
+
+    t->source = zmalloc(len);
+    t->rng    = (seed + 1) * 0x9E3779B97F4A7C15ULL;
+    memcpy(t->source, src, len);
+
+    end  = t->source + len;
+    body = search(t->source, end, "\r\n\r\n");
+    body = body ? body + 4 : end;
+
+    open   = search(body, end, "{{");
+    length = search(t->source, body, "\r\nContent-Length: ");
+
+    if (open && search(open + 2, end, "}}") && length) {
+        char *value = length + strlen("\r\nContent-Length: ");
+        char *digits = value;
+        while (digits < body && *digits >= '0' && *digits <= '9') digits++;
+
+        if (!parse(t, t->source, value)) goto error;
+        add_segment(t, LENGTH);
+        if (!parse(t, digits, body)) goto error;
+        t->length = true;
+    } else {
+        if (!parse(t, t->source, body)) goto error;
+    }
+
+    t->body = t->count;
+    if (!parse(t, body, end)) goto error;
+
+    t->size    = segments_size(t->segments, &t->segments[t->count]);
+    t->scratch = zmalloc(segments_size(&t->segments[t->body], &t->segments[t->count]) + 1);
+
+    return t;
+
+  error:
+    template_free(t);
+    return NULL;
+}
+
+void template_free(template *t) {
+    for (size_t i = 0; i < t->count; i++) {
+        segment *s = &t->segments[i];
+        if (s->type == LIST) {
+            zfree(s->str);
+            zfree(s->items);
+        }
+    }
+    zfree(t->segments);
+    zfree(t->scratch);
+    zfree(t->source);
+    zfree(t);
+}
+
+static uint64_t next_random(template *t) {
+    uint64_t x = t->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    t->rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static char *render_number(char *p, uint64_t n) {
+    char tmp[NUMBER_MAX], *c = tmp + sizeof(tmp);
+    do {
+        *--c = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    size_t len = tmp + sizeof(tmp) - c;
+    memcpy(p, c, len);
+    return p + len;
+}
+
+static char *render(template *t, segment *s, segment *end, char *p, size_t length) {
+    for (; s < end; s++) {
+        segment *item = s;
+        uint64_t span;
+
+        switch (s->type) {
+            case LITERAL:
+                break;
+            case SEQ:
+                p = render_number(p, t->seq);
+                continue;
+            case RAND:
+                span = s->max - s->min + 1;
+                p = render_number(p, s->min + (span ? next_random(t) % span : next_random(t)));
+                continue;
+            case LIST:
+                item = &s->items[next_random(t) % s->count];
+                break;
+            case LENGTH:
+                p = render_number(p, length);
+                continue;
+        }
+
+        memcpy(p, item->str, item->len);
+        p += item->len;
+    }
+    return p;
+}
+
+void template_render(template *t, char **buf, size_t *len) {
+    segment *head = t->segments;
+    segment *body = &t->segments[t->body];
+    segment *end  = &t->segments[t->count];
+    size_t length = 0;
+    char *p;
+
+    *buf = realloc(*buf, t->size);
+
+    if (t->length) {
+        length = render(t, body, end, t->scratch, 0) - t->scratch;
+        p = render(t, head, body, *buf, length);
+        memcpy(p, t->scratch, length);
+        p += length;
+    } else {
+        p = render(t, head, end, *buf, 0);
+    }
+
+    *len = p - *buf;
+    t->seq++;
+}
@@ -0,0 +1,15 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct template template;
+
+template *template_compile(char *, size_t, uint64_t);
+void template_free(template *);
+
+void template_render(template *, char **, size_t *);
+
+#endif /* TEMPLATE_H */
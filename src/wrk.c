@@ -8,21 +8,69 @@ static struct config {
     uint64_t connections;
     uint64_t duration;
     uint64_t threads;
+    uint64_t processes;
     uint64_t timeout;
     uint64_t pipeline;
+    uint64_t sample;
     bool     delay;
+    uint64_t per_conn;
+    uint64_t connect_rate;
+    bool     rst;
+    bool     fastopen;
+    bool     tcp_info;
+    bool     rebalance;
+    enum {
+        BALANCE_NONE, BALANCE_ROUND_ROBIN, BALANCE_LEAST_INFLIGHT
+    } balance;
+    uint64_t resolve;
+    uint16_t port;
+    socklen_t bind_len;
+    struct sockaddr_storage bind;
+    bool     ktls;
+    bool     lowmem;
+    bool     early;
     bool     dynamic;
     bool     latency;
+    bool     response;
+    bool     scenario;
+    bool     body;
+    uint64_t body_limit;
     char    *host;
     char    *script;
-    SSL_CTX *ctx;
+    char    *template;
+    char    *corpus;
+    bool     tls;
+    tls_resume resume;
+    char    *ciphers;
+    char    *groups;
 } cfg;
 
 static struct {
     stats *latency;
     stats *requests;
+    stats *handshake;
+    stats *zero_rtt;
+    stats *one_rtt;
+    stats *rtt;
+    stats *retrans;
+    stats *rwnd_limited;
+    stats *cwnd;
+    stats *lag;
+    uint64_t nsteps;
+    step steps[MAX_STEPS];
 } statistics;
 
+static pthread_mutex_t steps_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static thread *threads;
+
+static struct {
+    target_set *set;
+    target  **all;
+    uint64_t count;
+    uint64_t next;
+} targets;
+
 static struct sock sock = {
     .connect  = sock_connect,
     .close    = sock_close,
@@ -47,11 +95,33 @@ static void usage() {
            "    -c, --connections <N>  Connections to keep open   \n"
            "    -d, --duration    <T>  Duration of test           \n"
            "    -t, --threads     <N>  Number of threads to use   \n"
+           "        --processes   <N>  Spread threads over N procs\n"
+           "        --rebalance        Shift load off busy threads\n"
            "                                                      \n"
            "    -s, --script      <S>  Load Lua script file       \n"
            "    -H, --header      <H>  Add header to request      \n"
+           "        --template    <S>  Request line template      \n"
+           "        --corpus      <F>  Replay requests from file  \n"
            "        --latency          Print latency statistics   \n"
+           "        --body-limit  <N>  Max response body captured \n"
            "        --timeout     <T>  Socket/request timeout     \n"
+           "        --reconnect        New connection per request \n"
+           "        --requests-per-conn                           \n"
+           "                      <N>  Requests per connection    \n"
+           "        --connect-rate <R> New connections per second \n"
+           "        --close-mode  <M>  graceful or rst            \n"
+           "        --bind    <A[:P]>  Source address and port    \n"
+           "        --tcp-fastopen     Send requests in the SYN   \n"
+           "        --tcp-info         Sample TCP_INFO statistics \n"
+           "        --balance     <M>  round-robin, least-inflight\n"
+           "        --resolve-interval                            \n"
+           "                      <T>  Re-resolve host every T    \n"
+           "        --tls-resume  <M>  none, ticket, or id        \n"
+           "        --tls-ciphers <S>  TLS cipher suites          \n"
+           "        --tls-groups  <S>  TLS key exchange groups    \n"
+           "        --ktls             Use kernel TLS if possible \n"
+           "        --tls-lowmem       Release idle TLS buffers   \n"
+           "        --tls-early-data   Send 0-RTT data on resume  \n"
            "    -v, --version          Print version details      \n"
            "                                                      \n"
            "  Numeric arguments may include a SI unit (1k, 1M, 1G)\n"
@@ -73,11 +143,14 @@ int main(int argc, char **argv) {
     char *service = port ? port : schema;
 
     if (!strncmp("https", schema, 5)) {
-        if ((cfg.ctx = ssl_init()) == NULL) {
+        SSL_CTX *ctx = ssl_init(cfg.resume, cfg.ciphers, cfg.groups, cfg.ktls, cfg.lowmem);
+        if (ctx == NULL) {
             fprintf(stderr, "unable to initialize SSL\n");
             ERR_print_errors_fp(stderr);
             exit(1);
         }
+        SSL_CTX_free(ctx);
+        cfg.tls = true;
         sock.connect  = ssl_connect;
         sock.close    = ssl_close;
         sock.read     = ssl_read;
@@ -88,9 +161,24 @@ int main(int argc, char **argv) {
     signal(SIGPIPE, SIG_IGN);
     signal(SIGINT,  SIG_IGN);
 
-    statistics.latency  = stats_alloc(cfg.timeout * 1000);
-    statistics.requests = stats_alloc(MAX_THREAD_RATE_S);
-    thread *threads     = zcalloc(cfg.threads * sizeof(thread));
+    statistics.latency  = alloc_stats(cfg.timeout * 1000);
+    statistics.requests = alloc_stats(MAX_THREAD_RATE_S);
+    statistics.lag      = alloc_stats(cfg.timeout * 1000);
+    if (cfg.tls) {
+        statistics.handshake = alloc_stats(cfg.timeout * 1000);
+    }
+    if (cfg.tcp_info) {
+        statistics.rtt          = alloc_stats(cfg.timeout * 1000);
+        statistics.retrans      = alloc_stats(10000);
+        statistics.rwnd_limited = alloc_stats(100);
+        statistics.cwnd         = alloc_stats(100000);
+    }
+    if (cfg.early) {
+        statistics.zero_rtt = alloc_stats(cfg.timeout * 1000);
+        statistics.one_rtt  = alloc_stats(cfg.timeout * 1000);
+    }
+    threads = cfg.processes ? shared_alloc(cfg.threads * sizeof(thread))
+                            : zcalloc(cfg.threads * sizeof(thread));
 
     lua_State *L = script_create(cfg.script, url, headers);
     if (!script_resolve(L, host, service)) {
@@ -99,32 +187,73 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
+    if (cfg.resolve && !cfg.balance) {
+        cfg.balance = BALANCE_ROUND_ROBIN;
+    }
+
+    if (cfg.balance) {
+        targets.set = resolve_targets(L);
+    }
+
     cfg.host = host;
 
+    corpus *corpus = NULL;
+    uint64_t first = 0;
+
     for (uint64_t i = 0; i < cfg.threads; i++) {
         thread *t      = &threads[i];
-        t->loop        = aeCreateEventLoop(10 + cfg.connections * 3);
-        t->connections = cfg.connections / cfg.threads;
+        t->id          = i;
+        t->connections = cfg.connections / cfg.threads + (i < cfg.connections % cfg.threads);
+        t->first       = first;
+        first += t->connections;
+        if (cfg.connect_rate) {
+            t->interval = MAX(1000000 * cfg.threads / cfg.connect_rate, 1);
+        }
 
         t->L = script_create(cfg.script, url, headers);
         script_init(L, t, argc - optind, &argv[optind]);
 
+        if (cfg.template && !(t->template = compile_template(t->L, cfg.template, i))) {
+            exit(1);
+        }
+
+        if (cfg.corpus) {
+            if (!corpus && !(corpus = open_corpus(t->L, cfg.corpus))) exit(1);
+            t->corpus = corpus;
+            t->cursor = i;
+        }
+
         if (i == 0) {
-            cfg.pipeline = script_verify_request(t->L);
-            cfg.dynamic  = !script_is_static(t->L);
+            cfg.scenario = script_has_scenario(t->L);
+            cfg.response = script_want_response(t->L);
+            bool replay  = cfg.scenario || cfg.template || cfg.corpus;
+            cfg.pipeline = replay ? 1 : script_verify_request(t->L);
+            cfg.dynamic  = replay || !script_is_static(t->L);
             cfg.delay    = script_has_delay(t->L);
-            if (script_want_response(t->L)) {
+            cfg.sample   = script_response_sample(t->L);
+            if (cfg.response || cfg.scenario) {
                 parser_settings.on_header_field = header_field;
                 parser_settings.on_header_value = header_value;
-                parser_settings.on_body         = response_body;
+                cfg.body = cfg.scenario || script_want_body(t->L);
+                if (cfg.body) {
+                    parser_settings.on_body = response_body;
+                }
+            }
+            if (cfg.scenario && cfg.sample > 1) {
+                fprintf(stderr, "scenario scripts cannot set wrk.response_sample_rate\n");
+                exit(1);
+            }
+            if (cfg.scenario && cfg.processes) {
+                fprintf(stderr, "scenario scripts cannot be used with --processes\n");
+                exit(1);
+            }
+            if (cfg.scenario && cfg.rebalance) {
+                fprintf(stderr, "scenario scripts cannot be used with --rebalance\n");
+                exit(1);
             }
         }
 
-        if (!t->loop || pthread_create(&t->thread, NULL, &thread_main, t)) {
-            char *msg = strerror(errno);
-            fprintf(stderr, "unable to create thread %"PRIu64": %s\n", i, msg);
-            exit(2);
-        }
+        if (!cfg.processes) start_thread(t);
     }
 
     struct sigaction sa = {
@@ -134,6 +263,27 @@ int main(int argc, char **argv) {
     sigfillset(&sa.sa_mask);
     sigaction(SIGINT, &sa, NULL);
 
+    pid_t *workers = NULL;
+    size_t *worker_rss = NULL;
+
+    if (cfg.processes) {
+        workers    = zcalloc(cfg.processes * sizeof(pid_t));
+        worker_rss = shared_alloc(cfg.processes * sizeof(size_t));
+        fflush(stdout);
+        fflush(stderr);
+
+        for (uint64_t i = 0; i < cfg.processes; i++) {
+            if ((workers[i] = fork()) == 0) {
+                run_worker(i, &worker_rss[i]);
+            } else if (workers[i] == -1) {
+                char *msg = strerror(errno);
+                fprintf(stderr, "unable to create worker %"PRIu64": %s\n", i, msg);
+                while (i--) kill(workers[i], SIGKILL);
+                exit(2);
+            }
+        }
+    }
+
     char *time = format_time_s(cfg.duration);
     printf("Running %s test @ %s\n", time, url);
     printf("  %"PRIu64" threads and %"PRIu64" connections\n", cfg.threads, cfg.connections);
@@ -141,23 +291,88 @@ int main(int argc, char **argv) {
     uint64_t start    = time_us();
     uint64_t complete = 0;
     uint64_t bytes    = 0;
+    uint64_t handshakes = 0;
+    uint64_t resumed    = 0;
+    uint64_t ktls_send  = 0;
+    uint64_t ktls_recv  = 0;
+    uint64_t early_accepted = 0;
+    uint64_t early_rejected = 0;
+    uint64_t tfo            = 0;
+    uint64_t tfo_accepted   = 0;
+    uint64_t handoffs       = 0;
+    uint64_t truncated      = 0;
+    uint64_t busy_max       = 0;
+    uint64_t lua_us         = 0;
+    uint64_t lag_max        = 0;
     errors errors     = { 0 };
 
-    sleep(cfg.duration);
+    if (cfg.resolve) {
+        uint64_t end = start + cfg.duration * 1000000;
+        uint64_t now;
+        while (!stop && (now = time_us()) < end) {
+            sleep(MIN(cfg.resolve, (end - now + 999999) / 1000000));
+            if (stop || time_us() >= end) break;
+            if (script_resolve(L, host, service)) {
+                __atomic_store_n(&targets.set, resolve_targets(L), __ATOMIC_RELEASE);
+            }
+        }
+    } else {
+        sleep(cfg.duration);
+    }
+    size_t rss = zmalloc_get_rss();
+    uint64_t failed = 0;
+
+    if (cfg.processes) {
+        rss = 0;
+        for (uint64_t i = 0; i < cfg.processes; i++) {
+            if (stop) kill(workers[i], SIGINT);
+        }
+        for (uint64_t i = 0; i < cfg.processes; i++) {
+            if (!wait_worker(workers[i], i)) failed++;
+            rss += worker_rss[i];
+        }
+    }
     stop = 1;
 
     for (uint64_t i = 0; i < cfg.threads; i++) {
         thread *t = &threads[i];
-        pthread_join(t->thread, NULL);
+        if (!cfg.processes) pthread_join(t->thread, NULL);
 
         complete += t->complete;
         bytes    += t->bytes;
 
+        handshakes += t->handshakes;
+        resumed    += t->resumed;
+        ktls_send  += t->ktls_send;
+        ktls_recv  += t->ktls_recv;
+
+        early_accepted += t->early_accepted;
+        early_rejected += t->early_rejected;
+        tfo            += t->tfo;
+        tfo_accepted   += t->tfo_accepted;
+        handoffs       += t->handoffs;
+        truncated      += t->truncated;
+
+        busy_max = MAX(busy_max, t->busy_us);
+        lag_max  = MAX(lag_max,  t->lag_max);
+        lua_us  += t->lua_us;
+
         errors.connect += t->errors.connect;
         errors.read    += t->errors.read;
         errors.write   += t->errors.write;
         errors.timeout += t->errors.timeout;
         errors.status  += t->errors.status;
+        errors.close   += t->errors.close;
+        errors.scenario += t->errors.scenario;
+    }
+
+    for (uint64_t i = 0; !cfg.processes && i < cfg.threads; i++) {
+        connection *c = threads[i].cs;
+        for (uint64_t j = 0; j < threads[i].connections; j++, c++) {
+            free(c->headers.buffer);
+            free(c->body.buffer);
+        }
+        zfree(threads[i].cs);
     }
 
     uint64_t runtime_us = time_us() - start;
@@ -165,6 +380,11 @@ int main(int argc, char **argv) {
     long double req_per_s   = complete   / runtime_s;
     long double bytes_per_s = bytes      / runtime_s;
 
+    long double busy_pct = busy_max * 100.0 / runtime_us;
+    long double lua_pct  = lua_us * 100.0 / (runtime_us * cfg.threads);
+    uint64_t lag_p99     = stats_percentile(statistics.lag, 99.0);
+    bool saturated       = busy_pct > BUSY_WARN_PCT || lag_p99 > LOOP_LAG_WARN_US;
+
     if (complete / cfg.connections > 0) {
         int64_t interval = runtime_us / (complete / cfg.connections);
         stats_correct(statistics.latency, interval);
@@ -173,11 +393,43 @@ int main(int argc, char **argv) {
     print_stats_header();
     print_stats("Latency", statistics.latency, format_time_us);
     print_stats("Req/Sec", statistics.requests, format_metric);
+    if (cfg.tls) print_stats("Handshake", statistics.handshake, format_time_us);
+    if (cfg.early) {
+        print_stats("0-RTT", statistics.zero_rtt, format_time_us);
+        print_stats("1-RTT", statistics.one_rtt,  format_time_us);
+    }
     if (cfg.latency) print_stats_latency(statistics.latency);
+    if (cfg.tcp_info) {
+        print_stats("TCP RTT",  statistics.rtt,          format_time_us);
+        print_stats("Retrans",  statistics.retrans,      format_metric);
+        print_stats("Rwnd %",   statistics.rwnd_limited, format_metric);
+        print_stats("Cwnd",     statistics.cwnd,         format_metric);
+    }
+    if (saturated) print_stats("Loop lag", statistics.lag, format_time_us);
+    if (statistics.nsteps) print_stats_steps();
+    if (cfg.balance) print_stats_targets();
 
     char *runtime_msg = format_time_us(runtime_us);
 
     printf("  %"PRIu64" requests in %s, %sB read\n", complete, runtime_msg, format_binary(bytes));
+    if (cfg.tls) {
+        printf("  %"PRIu64" TLS handshakes, %"PRIu64" resumed, %sB resident\n", handshakes, resumed, format_binary(rss));
+    }
+    if (cfg.ktls) {
+        printf("  %"PRIu64" kTLS send, %"PRIu64" kTLS receive offloads\n", ktls_send, ktls_recv);
+    }
+    if (cfg.early) {
+        printf("  %"PRIu64" early data accepted, %"PRIu64" rejected\n", early_accepted, early_rejected);
+    }
+    if (cfg.fastopen) {
+        printf("  %"PRIu64" TCP Fast Open connects, %"PRIu64" accepted\n", tfo, tfo_accepted);
+    }
+    if (cfg.rebalance) {
+        printf("  %"PRIu64" connections moved off busy threads\n", handoffs);
+    }
+    if (truncated) {
+        printf("  %"PRIu64" response bodies truncated to %sB\n", truncated, format_metric(cfg.body_limit));
+    }
     if (errors.connect || errors.read || errors.write || errors.timeout) {
         printf("  Socket errors: connect %d, read %d, write %d, timeout %d\n",
                errors.connect, errors.read, errors.write, errors.timeout);
@@ -187,18 +439,110 @@ int main(int argc, char **argv) {
         printf("  Non-2xx or 3xx responses: %d\n", errors.status);
     }
 
+    if (errors.close) {
+        printf("  Close errors: %d\n", errors.close);
+    }
+
+    if (errors.scenario) {
+        printf("  Scenario errors: %d\n", errors.scenario);
+    }
+
+    if (failed) {
+        printf("  Failed workers: %"PRIu64" of %"PRIu64"\n", failed, cfg.processes);
+    }
+
+    if (saturated) {
+        printf("  Busiest thread %.1Lf%% busy, %.1Lf%% of thread time in Lua, max loop lag %s\n",
+               busy_pct, lua_pct, format_time_us(lag_max));
+        printf("  WARNING: wrk threads were saturated, results may be limited by the load generator\n");
+    }
+
     printf("Requests/sec: %9.2Lf\n", req_per_s);
     printf("Transfer/sec: %10sB\n", format_binary(bytes_per_s));
+    if (cfg.tls) {
+        printf("Handshakes/sec: %7.2Lf\n", handshakes / runtime_s);
+    }
 
     if (script_has_done(L)) {
         script_summary(L, runtime_us, complete, bytes);
         script_errors(L, &errors);
+        if (cfg.tcp_info) {
+            script_tcp(L, statistics.rtt, statistics.retrans, statistics.rwnd_limited, statistics.cwnd);
+        }
+        if (cfg.balance) {
+            script_targets(L, targets.all, targets.count);
+        }
+        script_load(L, threads, cfg.threads, statistics.lag);
         script_done(L, statistics.latency, statistics.requests);
     }
 
     return 0;
 }
 
+static void start_thread(thread *t) {
+    t->loop = aeCreateEventLoop(10 + t->connections);
+    if (!t->loop || pthread_create(&t->thread, NULL, &thread_main, t)) {
+        char *msg = strerror(errno);
+        fprintf(stderr, "unable to create thread %"PRIu64": %s\n", t->id, msg);
+        exit(2);
+    }
+}
+
+static void run_worker(uint64_t id, size_t *rss) {
+    for (uint64_t i = id; i < cfg.threads; i += cfg.processes) {
+        start_thread(&threads[i]);
+    }
+
+    sleep(cfg.duration);
+    *rss = zmalloc_get_rss();
+    stop = 1;
+
+    for (uint64_t i = id; i < cfg.threads; i += cfg.processes) {
+        pthread_join(threads[i].thread, NULL);
+    }
+
+    exit(0);
+}
+
+static bool wait_worker(pid_t pid, uint64_t id) {
+    int status;
+
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) return false;
+    }
+
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "worker %"PRIu64" killed by signal %d\n", id, WTERMSIG(status));
+        return false;
+    }
+
+    if (WEXITSTATUS(status)) {
+        fprintf(stderr, "worker %"PRIu64" exited with status %d\n", id, WEXITSTATUS(status));
+        return false;
+    }
+
+    return true;
+}
+
+static void *shared_alloc(size_t size) {
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "unable to map %zu bytes: %s\n", size, strerror(errno));
+        exit(1);
+    }
+    return ptr;
+}
+
+static stats *alloc_stats(uint64_t max) {
+    if (!cfg.processes) return stats_alloc(max);
+    stats *s = stats_alloc_shared(max);
+    if (!s) {
+        fprintf(stderr, "unable to map statistics: %s\n", strerror(errno));
+        exit(1);
+    }
+    return s;
+}
+
 void *thread_main(void *arg) {
     thread *thread = arg;
 
@@ -209,26 +553,56 @@ void *thread_main(void *arg) {
         script_request(thread->L, &request, &length);
     }
 
+    if (cfg.tls) {
+        thread->ctx = ssl_init(cfg.resume, cfg.ciphers, cfg.groups, cfg.ktls, cfg.lowmem);
+        if (thread->ctx == NULL) {
+            fprintf(stderr, "unable to initialize SSL for thread %"PRIu64"\n", thread->id);
+            ERR_print_errors_fp(stderr);
+            exit(1);
+        }
+    }
+
     thread->cs = zcalloc(thread->connections * sizeof(connection));
     connection *c = thread->cs;
 
     for (uint64_t i = 0; i < thread->connections; i++, c++) {
         c->thread = thread;
-        c->ssl     = cfg.ctx ? SSL_new(cfg.ctx) : NULL;
+        c->fd      = -1;
+        c->port    = cfg.port ? cfg.port + thread->first + i : 0;
         c->request = request;
         c->length  = length;
         c->delayed = cfg.delay;
-        connect_socket(thread, c);
+        schedule_connect(thread, c);
     }
 
     aeEventLoop *loop = thread->loop;
     aeCreateTimeEvent(loop, RECORD_INTERVAL_MS, record_rate, thread, NULL);
 
-    thread->start = time_us();
+    loop->privdata = thread;
+    aeSetBeforeSleepProc(loop, loop_sleep);
+    aeSetAfterSleepProc(loop, loop_wake);
+
+    uint64_t begin = time_us();
+
+    thread->owned      = thread->connections;
+    thread->start      = begin;
+    thread->load_start = begin;
+    thread->due        = begin + RECORD_INTERVAL_MS * 1000;
     aeMain(loop);
+    measure_load(thread);
+    thread->busy_us = time_us() - begin - thread->idle_us;
+
+    c = __atomic_exchange_n(&thread->handoff, HANDOFF_CLOSED, __ATOMIC_ACQUIRE);
+    while (c) {
+        connection *next = c->next;
+        c->next = NULL;
+        close_socket(thread, c);
+        c = next;
+    }
 
     aeDeleteEventLoop(loop);
-    zfree(thread->cs);
+    if (thread->template) template_free(thread->template);
+    while (thread->pooled) free(thread->pool[--thread->pooled].buffer);
 
     return NULL;
 }
@@ -238,11 +612,48 @@ static int connect_socket(thread *thread, connection *c) {
     struct aeEventLoop *loop = thread->loop;
     int fd, flags;
 
+    if (cfg.balance) {
+        c->target = next_target();
+        addr = &c->target->addr;
+    }
+
     fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
 
     flags = fcntl(fd, F_GETFL, 0);
     fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 
+    if (cfg.bind_len) {
+        struct sockaddr_storage local = cfg.bind;
+        uint16_t port = htons(c->port);
+
+        if (local.ss_family == AF_INET6) {
+            ((struct sockaddr_in6 *) &local)->sin6_port = port;
+        } else {
+            ((struct sockaddr_in *) &local)->sin_port = port;
+        }
+
+        flags = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flags, sizeof(flags));
+#ifdef IP_BIND_ADDRESS_NO_PORT
+        if (!c->port) setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &flags, sizeof(flags));
+#endif
+        if (bind(fd, (struct sockaddr *) &local, cfg.bind_len) == -1) goto error;
+    }
+
+#ifdef TCP_FASTOPEN_CONNECT
+    flags = 1;
+    if (cfg.fastopen && !setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &flags, sizeof(flags))) {
+        thread->tfo++;
+    }
+#endif
+
+    if (thread->ctx && !c->ssl) {
+        c->ssl = SSL_new(thread->ctx);
+    }
+
+    c->connect = time_us();
+    c->retrans = 0;
+    c->served  = 0;
     if (connect(fd, addr->ai_addr, addr->ai_addrlen) == -1) {
         if (errno != EINPROGRESS) goto error;
     }
@@ -259,19 +670,194 @@ static int connect_socket(thread *thread, connection *c) {
 
   error:
     thread->errors.connect++;
+    target_error(c);
     close(fd);
+    backoff_connect(thread, c);
     return -1;
 }
 
-static int reconnect_socket(thread *thread, connection *c) {
+static void close_socket(thread *thread, connection *c) {
     aeDeleteFileEvent(thread->loop, c->fd, AE_WRITABLE | AE_READABLE);
+    if (c->target && c->pending) {
+        __sync_fetch_and_sub(&c->target->inflight, c->pending);
+        c->pending = 0;
+    }
     sock.close(c);
-    close(c->fd);
-    return connect_socket(thread, c);
+    if (cfg.rst) {
+        struct linger linger = { .l_onoff = 1, .l_linger = 0 };
+        if (setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger))) {
+            thread->errors.close++;
+        }
+    }
+    if (close(c->fd) == -1) {
+        thread->errors.close++;
+    }
+    c->fd     = -1;
+    c->resend = false;
+}
+
+static int reconnect_socket(thread *thread, connection *c) {
+    close_socket(thread, c);
+    return schedule_connect(thread, c);
+}
+
+static target_set *resolve_targets(lua_State *L) {
+    uint64_t count;
+    struct addrinfo *addrs = script_addrs(L, &count);
+    target_set *set = zcalloc(sizeof(target_set) + count * sizeof(target *));
+
+    for (uint64_t i = 0; i < count; i++) {
+        char *name = format_addr(&addrs[i]);
+        target *t  = NULL;
+
+        for (uint64_t j = 0; j < targets.count && !t; j++) {
+            if (!strcmp(targets.all[j]->name, name)) t = targets.all[j];
+        }
+
+        if (t) {
+            zfree(addrs[i].ai_addr);
+            free(name);
+        } else {
+            t = cfg.processes ? shared_alloc(sizeof(target)) : zcalloc(sizeof(target));
+            t->addr    = addrs[i];
+            t->name    = name;
+            t->latency = alloc_stats(cfg.timeout * 1000);
+            targets.all = zrealloc(targets.all, (targets.count + 1) * sizeof(target *));
+            targets.all[targets.count++] = t;
+        }
+
+        set->targets[set->count++] = t;
+    }
+
+    zfree(addrs);
+    return set;
+}
+
+static target *next_target() {
+    target_set *set = __atomic_load_n(&targets.set, __ATOMIC_ACQUIRE);
+
+    if (cfg.balance == BALANCE_ROUND_ROBIN) {
+        return set->targets[__sync_fetch_and_add(&targets.next, 1) % set->count];
+    }
+
+    uint64_t start = __sync_fetch_and_add(&targets.next, 1);
+    target *best = NULL;
+
+    for (uint64_t i = 0; i < set->count; i++) {
+        target *t = set->targets[(start + i) % set->count];
+        if (!best || t->inflight < best->inflight) best = t;
+    }
+
+    return best;
+}
+
+static void target_error(connection *c) {
+    if (c->target) __sync_fetch_and_add(&c->target->errors, 1);
+}
+
+static char *format_addr(struct addrinfo *addr) {
+    char host[NI_MAXHOST];
+    char service[NI_MAXSERV];
+    char *name = NULL;
+
+    if (addr->ai_family == AF_UNIX) {
+        aprintf(&name, "unix:%s", ((struct sockaddr_un *) addr->ai_addr)->sun_path);
+        return name;
+    }
+
+    int flags = NI_NUMERICHOST | NI_NUMERICSERV;
+    if (getnameinfo(addr->ai_addr, addr->ai_addrlen, host, NI_MAXHOST, service, NI_MAXSERV, flags)) {
+        strcpy(host, "?");
+        strcpy(service, "?");
+    }
+
+    aprintf(&name, addr->ai_family == AF_INET6 ? "[%s]:%s" : "%s:%s", host, service);
+    return name;
+}
+
+static int schedule_connect(thread *thread, connection *c) {
+    if (!thread->interval) return connect_socket(thread, c);
+
+    uint64_t now = time_us();
+    if (!thread->queue && thread->next_connect <= now) {
+        thread->next_connect = now + thread->interval;
+        return connect_socket(thread, c);
+    }
+
+    c->next = NULL;
+    if (thread->tail) {
+        thread->tail->next = c;
+    } else {
+        thread->queue = c;
+        aeCreateTimeEvent(thread->loop, 1, connect_queued, thread, NULL);
+    }
+    thread->tail = c;
+    return 0;
+}
+
+static int connect_queued(aeEventLoop *loop, long long id, void *data) {
+    thread *thread = data;
+    uint64_t now = time_us();
+
+    while (thread->queue && thread->next_connect <= now) {
+        connection *c = thread->queue;
+        if (!(thread->queue = c->next)) thread->tail = NULL;
+        thread->next_connect += thread->interval;
+        connect_socket(thread, c);
+    }
+
+    return thread->queue ? 1 : AE_NOMORE;
+}
+
+// Failed connects are retried after a delay that doubles with each
+// consecutive failure, through the pacing queue when --connect-rate is set.
+
+static void backoff_connect(thread *thread, connection *c) {
+    uint64_t delay = CONNECT_RETRY_MS << MIN(c->failures, 7);
+    c->failures++;
+    aeCreateTimeEvent(thread->loop, MIN(delay, CONNECT_RETRY_MAX_MS), retry_connect, c, NULL);
+}
+
+static int retry_connect(aeEventLoop *loop, long long id, void *data) {
+    connection *c = data;
+    schedule_connect(c->thread, c);
+    return AE_NOMORE;
+}
+
+static template *compile_template(lua_State *L, char *src, uint64_t seed) {
+    char *method = NULL, *path = src, *request = NULL;
+    char *space = strchr(src, ' ');
+    size_t length;
+
+    if (space) {
+        method = zcalloc(space - src + 1);
+        memcpy(method, src, space - src);
+        path = space + 1;
+    }
+
+    script_format(L, method, path, &request, &length);
+    template *t = template_compile(request, length, seed);
+
+    zfree(method);
+    free(request);
+    return t;
+}
+
+static corpus *open_corpus(lua_State *L, char *file) {
+    char *host = script_header(L, "Host");
+    corpus *corpus = corpus_open(file, host ? host : "");
+    zfree(host);
+    return corpus;
 }
 
 static int record_rate(aeEventLoop *loop, long long id, void *data) {
     thread *thread = data;
+    uint64_t now = time_us();
+    uint64_t lag = now > thread->due ? now - thread->due : 0;
+
+    stats_record(statistics.lag, lag);
+    thread->lag_max = MAX(thread->lag_max, lag);
+    thread->due     = now + RECORD_INTERVAL_MS * 1000;
 
     if (thread->requests > 0) {
         uint64_t elapsed_ms = (time_us() - thread->start) / 1000;
@@ -283,11 +869,112 @@ static int record_rate(aeEventLoop *loop, long long id, void *data) {
         thread->start    = time_us();
     }
 
+    if (cfg.tcp_info) sample_tcp_info(thread);
+    measure_load(thread);
+    if (cfg.rebalance) find_peer(thread);
+
     if (stop) aeStop(loop);
 
     return RECORD_INTERVAL_MS;
 }
 
+static void loop_sleep(aeEventLoop *loop) {
+    thread *thread = loop->privdata;
+    connection *c = __atomic_exchange_n(&thread->handoff, NULL, __ATOMIC_ACQUIRE);
+
+    while (c) {
+        connection *next = c->next;
+        c->next = NULL;
+        thread->owned++;
+        aeCreateFileEvent(loop, c->fd, AE_READABLE, socket_readable, c);
+        aeCreateFileEvent(loop, c->fd, AE_WRITABLE, socket_writeable, c);
+        c = next;
+    }
+
+    thread->sleep = time_us();
+}
+
+static void loop_wake(aeEventLoop *loop) {
+    thread *thread = loop->privdata;
+    thread->idle += time_us() - thread->sleep;
+}
+
+static void measure_load(thread *t) {
+    uint64_t now = time_us(), elapsed = now - t->load_start;
+    uint64_t idle = MIN(t->idle, elapsed);
+
+    if (elapsed) __atomic_store_n(&t->busy, 100 - idle * 100 / elapsed, __ATOMIC_RELAXED);
+    t->idle_us   += idle;
+    t->idle       = 0;
+    t->load_start = now;
+}
+
+static void find_peer(thread *t) {
+    thread *peer = NULL;
+    uint64_t best = BUSY_LOW_PCT;
+
+    t->peer = NULL;
+    if (t->busy < BUSY_HIGH_PCT || t->owned < 2) return;
+
+    for (uint64_t i = 0; i < cfg.threads; i++) {
+        thread *other = &threads[i];
+        if (other == t) continue;
+        if (cfg.processes && i % cfg.processes != t->id % cfg.processes) continue;
+        uint64_t load = __atomic_load_n(&other->busy, __ATOMIC_RELAXED);
+        if (load < best) {
+            peer = other;
+            best = load;
+        }
+    }
+
+    if (peer) {
+        t->peer   = peer;
+        t->budget = (t->owned + 7) / 8;
+    }
+}
+
+static void hand_off(connection *c) {
+    thread *t = c->thread, *peer = t->peer;
+
+    aeDeleteFileEvent(t->loop, c->fd, AE_READABLE | AE_WRITABLE);
+
+    c->handoff = false;
+    c->thread  = peer;
+    c->next    = __atomic_load_n(&peer->handoff, __ATOMIC_RELAXED);
+    do {
+        if (c->next == HANDOFF_CLOSED) {
+            // peer has left its event loop, keep the connection
+            c->thread = t;
+            c->next   = NULL;
+            t->peer   = NULL;
+            aeCreateFileEvent(t->loop, c->fd, AE_READABLE, socket_readable, c);
+            aeCreateFileEvent(t->loop, c->fd, AE_WRITABLE, socket_writeable, c);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&peer->handoff, &c->next, c, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    t->owned--;
+    t->handoffs++;
+    if (--t->budget == 0 || t->owned < 2) t->peer = NULL;
+}
+
+static void sample_tcp_info(thread *thread) {
+    uint64_t count = MIN(thread->connections, TCP_INFO_SAMPLES);
+    tcp_sample sample;
+
+    for (uint64_t i = 0; i < count; i++) {
+        connection *c = &thread->cs[thread->tcp_cursor++ % thread->connections];
+        if (__atomic_load_n(&c->thread, __ATOMIC_RELAXED) != thread) continue;
+        if (!sock_tcp_info(c, &sample)) continue;
+        uint64_t retrans = sample.retrans - MIN(c->retrans, sample.retrans);
+        c->retrans = sample.retrans;
+        stats_record(statistics.rtt,          sample.rtt);
+        stats_record(statistics.retrans,      retrans);
+        stats_record(statistics.rwnd_limited, sample.rwnd_limited);
+        stats_record(statistics.cwnd,         sample.cwnd);
+    }
+}
+
 static int delay_request(aeEventLoop *loop, long long id, void *data) {
     connection *c = data;
     c->delayed = false;
@@ -295,8 +982,34 @@ static int delay_request(aeEventLoop *loop, long long id, void *data) {
     return AE_NOMORE;
 }
 
+static void borrow_buffer(thread *thread, buffer *b) {
+    if (!b->buffer && thread->pooled) {
+        *b = thread->pool[--thread->pooled];
+    }
+}
+
+static void release_buffer(thread *thread, buffer *b) {
+    if (!b->buffer) return;
+    if (thread->pooled < BUFFER_POOL && b->length <= BUFFER_POOL_MAX) {
+        buffer_reset(b);
+        thread->pool[thread->pooled++] = *b;
+    } else {
+        free(b->buffer);
+    }
+    *b = (buffer) { 0 };
+}
+
+static void release_buffers(connection *c) {
+    release_buffer(c->thread, &c->headers);
+    release_buffer(c->thread, &c->body);
+    c->truncated = false;
+    c->state = FIELD;
+}
+
 static int header_field(http_parser *parser, const char *at, size_t len) {
     connection *c = parser->data;
+    if (!c->sample) return 0;
+    borrow_buffer(c->thread, &c->headers);
     if (c->state == VALUE) {
         *c->headers.cursor++ = '\0';
         c->state = FIELD;
@@ -307,6 +1020,8 @@ static int header_field(http_parser *parser, const char *at, size_t len) {
 
 static int header_value(http_parser *parser, const char *at, size_t len) {
     connection *c = parser->data;
+    if (!c->sample) return 0;
+    borrow_buffer(c->thread, &c->headers);
     if (c->state == FIELD) {
         *c->headers.cursor++ = '\0';
         c->state = VALUE;
@@ -317,43 +1032,132 @@ static int header_value(http_parser *parser, const char *at, size_t len) {
 
 static int response_body(http_parser *parser, const char *at, size_t len) {
     connection *c = parser->data;
+    if (!c->sample) return 0;
+    borrow_buffer(c->thread, &c->body);
+    if (cfg.body_limit) {
+        size_t used = c->body.cursor - c->body.buffer;
+        if (used + len > cfg.body_limit) {
+            if (!c->truncated) c->thread->truncated++;
+            c->truncated = true;
+            len = cfg.body_limit - used;
+        }
+    }
     buffer_append(&c->body, at, len);
     return 0;
 }
 
+static bool sample_response(thread *thread) {
+    return thread->sampled++ % cfg.sample == 0;
+}
+
+static step *lookup_step(const char *name) {
+    uint64_t count = __atomic_load_n(&statistics.nsteps, __ATOMIC_ACQUIRE);
+    step *s = statistics.steps;
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (!strcmp(s[i].name, name)) return &s[i];
+    }
+
+    pthread_mutex_lock(&steps_lock);
+    for (count = statistics.nsteps; s < &statistics.steps[count]; s++) {
+        if (!strcmp(s->name, name)) break;
+    }
+    if (s == &statistics.steps[count]) {
+        if (count == MAX_STEPS) {
+            fprintf(stderr, "scenario() used more than %d step names\n", MAX_STEPS);
+            exit(1);
+        }
+        s->name    = zstrdup(name);
+        s->latency = stats_alloc(cfg.timeout * 1000);
+        __atomic_store_n(&statistics.nsteps, count + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&steps_lock);
+
+    return s;
+}
+
+static bool next_step(thread *thread, connection *c, int status) {
+    uint64_t start = time_us();
+    const char *cause;
+    const char *name = script_step(thread->L, c, status, &cause);
+    thread->lua_us += time_us() - start;
+    if (!name) {
+        if (!thread->errors.scenario++) {
+            fprintf(stderr, "scenario: %s\n", cause);
+        }
+        if (c->step) __sync_fetch_and_add(&c->step->errors, 1);
+        free(c->request);
+        c->request = NULL;
+        c->length  = 0;
+        c->step    = NULL;
+        return false;
+    }
+    c->step = lookup_step(name);
+    return true;
+}
+
 static int response_complete(http_parser *parser) {
     connection *c = parser->data;
     thread *thread = c->thread;
     uint64_t now = time_us();
     int status = parser->status_code;
+    bool failed = false;
 
     thread->complete++;
     thread->requests++;
 
     if (status > 399) {
         thread->errors.status++;
+        target_error(c);
     }
 
-    if (c->headers.buffer) {
-        *c->headers.cursor++ = '\0';
-        script_response(thread->L, status, &c->headers, &c->body);
-        c->state = FIELD;
+    if (c->sample) {
+        if (c->headers.buffer) *c->headers.cursor++ = '\0';
+        if (cfg.response) {
+            script_response(thread->L, status, &c->headers, cfg.body ? &c->body : NULL);
+            thread->lua_us += time_us() - now;
+        }
+        if (cfg.scenario) {
+            if (c->step) stats_record(c->step->latency, now - c->start);
+            failed = !next_step(thread, c, status);
+        }
+        release_buffers(c);
+    }
+
+    if (c->first) {
+        stats *stats = c->first == RTT_ZERO ? statistics.zero_rtt : statistics.one_rtt;
+        stats_record(stats, now - c->connect);
+        c->first = RTT_NONE;
+    }
+
+    if (c->target) {
+        __sync_fetch_and_add(&c->target->requests, 1);
+        __sync_fetch_and_sub(&c->target->inflight, 1);
     }
 
     if (--c->pending == 0) {
         if (!stats_record(statistics.latency, now - c->start)) {
             thread->errors.timeout++;
+            target_error(c);
         }
+        if (c->target) stats_record(c->target->latency, now - c->start);
         c->delayed = cfg.delay;
         aeCreateFileEvent(thread->loop, c->fd, AE_WRITABLE, socket_writeable, c);
     }
 
-    if (!http_should_keep_alive(parser)) {
+    if (cfg.fastopen && !c->served && sock_syn_data(c)) {
+        thread->tfo_accepted++;
+    }
+
+    c->served++;
+    if (failed || !http_should_keep_alive(parser) || (cfg.per_conn && c->served >= cfg.per_conn && !c->pending)) {
         reconnect_socket(thread, c);
         goto done;
     }
 
     http_parser_init(parser, HTTP_RESPONSE);
+    c->sample = sample_response(thread);
+    if (thread->peer && !c->pending) c->handoff = true;
 
   done:
     return 0;
@@ -361,6 +1165,26 @@ static int response_complete(http_parser *parser) {
 
 static void socket_connected(aeEventLoop *loop, int fd, void *data, int mask) {
     connection *c = data;
+    size_t n;
+
+    if (cfg.early && (c->early || ssl_early_capable(c))) {
+        if (!c->early) {
+            if (!prepare_request(c->thread, c)) {
+                close_socket(c->thread, c);
+                c->thread->owned--;
+                return;
+            }
+            c->early = true;
+        }
+        while (c->written < c->length) {
+            switch (ssl_write_early(c, cfg.host, c->request + c->written, c->length - c->written, &n)) {
+                case OK:    break;
+                case ERROR: goto error;
+                case RETRY: return;
+            }
+            c->written += n;
+        }
+    }
 
     switch (sock.connect(c, cfg.host)) {
         case OK:    break;
@@ -368,17 +1192,51 @@ static void socket_connected(aeEventLoop *loop, int fd, void *data, int mask) {
         case RETRY: return;
     }
 
+    if (cfg.tls) {
+        stats_record(statistics.handshake, time_us() - c->connect);
+        c->thread->handshakes++;
+        if (ssl_resumed(c)) c->thread->resumed++;
+        if (cfg.ktls) {
+            int ktls = ssl_ktls(c);
+            if (ktls & KTLS_SEND) c->thread->ktls_send++;
+            if (ktls & KTLS_RECV) c->thread->ktls_recv++;
+        }
+    }
+
     http_parser_init(&c->parser, HTTP_RESPONSE);
-    c->written = 0;
+    release_buffers(c);
+    c->sample   = sample_response(c->thread);
+    c->written  = 0;
+    c->failures = 0;
+
+    if (cfg.early) {
+        c->first = RTT_ONE;
+        if (c->early && ssl_early_accepted(c)) {
+            c->thread->early_accepted++;
+            c->first = RTT_ZERO;
+        } else if (c->early) {
+            c->thread->early_rejected++;
+            c->resend = true;
+        }
+    }
 
     aeCreateFileEvent(c->thread->loop, fd, AE_READABLE, socket_readable, c);
-    aeCreateFileEvent(c->thread->loop, fd, AE_WRITABLE, socket_writeable, c);
+    if (c->first != RTT_ZERO) {
+        aeCreateFileEvent(c->thread->loop, fd, AE_WRITABLE, socket_writeable, c);
+    } else {
+        aeDeleteFileEvent(c->thread->loop, fd, AE_WRITABLE);
+    }
+    c->early = false;
 
     return;
 
   error:
     c->thread->errors.connect++;
-    reconnect_socket(c->thread, c);
+    target_error(c);
+    close_socket(c->thread, c);
+    backoff_connect(c->thread, c);
+    c->early   = false;
+    c->written = 0;
 }
 
 static void socket_writeable(aeEventLoop *loop, int fd, void *data, int mask) {
@@ -386,18 +1244,20 @@ static void socket_writeable(aeEventLoop *loop, int fd, void *data, int mask) {
     thread *thread = c->thread;
 
     if (c->delayed) {
+        uint64_t start = time_us();
         uint64_t delay = script_delay(thread->L);
+        thread->lua_us += time_us() - start;
         aeDeleteFileEvent(loop, fd, AE_WRITABLE);
         aeCreateTimeEvent(loop, delay, delay_request, c, NULL);
         return;
     }
 
-    if (!c->written) {
-        if (cfg.dynamic) {
-            script_request(thread->L, &c->request, &c->length);
-        }
-        c->start   = time_us();
-        c->pending = cfg.pipeline;
+    if (c->resend) {
+        c->resend = false;
+    } else if (!c->written && !prepare_request(thread, c)) {
+        close_socket(thread, c);
+        thread->owned--;
+        return;
     }
 
     char  *buf = c->request + c->written;
@@ -420,9 +1280,31 @@ static void socket_writeable(aeEventLoop *loop, int fd, void *data, int mask) {
 
   error:
     thread->errors.write++;
+    target_error(c);
     reconnect_socket(thread, c);
 }
 
+static bool prepare_request(thread *thread, connection *c) {
+    if (cfg.scenario) {
+        if (!c->request && !next_step(thread, c, 0)) return false;
+    } else if (thread->template) {
+        template_render(thread->template, &c->request, &c->length);
+    } else if (thread->corpus) {
+        corpus_request(thread->corpus, thread->cursor, &c->request, &c->length);
+        thread->cursor += cfg.threads;
+    } else if (cfg.dynamic) {
+        uint64_t start = time_us();
+        script_request(thread->L, &c->request, &c->length);
+        thread->lua_us += time_us() - start;
+    }
+    if (c->target) {
+        __sync_fetch_and_add(&c->target->inflight, cfg.pipeline - c->pending);
+    }
+    c->start   = time_us();
+    c->pending = cfg.pipeline;
+    return true;
+}
+
 static void socket_readable(aeEventLoop *loop, int fd, void *data, int mask) {
     connection *c = data;
     size_t n;
@@ -434,16 +1316,20 @@ static void socket_readable(aeEventLoop *loop, int fd, void *data, int mask) {
             case RETRY: return;
         }
 
-        if (http_parser_execute(&c->parser, &parser_settings, c->buf, n) != n) goto error;
+        if (http_parser_execute(&c->parser, &parser_settings, c->thread->buf, n) != n) goto error;
         if (n == 0 && !http_body_is_final(&c->parser)) goto error;
 
         c->thread->bytes += n;
     } while (n == RECVBUF && sock.readable(c) > 0);
 
+    if (c->handoff) hand_off(c);
+
     return;
 
   error:
+    c->handoff = false;
     c->thread->errors.read++;
+    target_error(c);
     reconnect_socket(c->thread, c);
 }
 
@@ -466,14 +1352,94 @@ static char *copy_url_part(char *url, struct http_parser_url *parts, enum http_p
     return part;
 }
 
+static bool parse_bind(char *arg, struct config *cfg) {
+    struct addrinfo *addr, hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags    = AI_NUMERICHOST | AI_PASSIVE
+    };
+    char *host = zstrdup(arg), *port = NULL, *c;
+    bool ok = false;
+
+    if (*host == '[' && (c = strchr(host, ']'))) {
+        *c++ = '\0';
+        if (*c == ':') port = c + 1;
+        else if (*c) goto done;
+        memmove(host, host + 1, strlen(host));
+    } else if ((c = strchr(host, ':')) && !strchr(c + 1, ':')) {
+        *c = '\0';
+        port = c + 1;
+    }
+
+    if (port) {
+        char *end;
+        unsigned long n = strtoul(port, &end, 10);
+        if (*end || n == 0 || n > 65535) goto done;
+        cfg->port = n;
+    }
+
+    if (getaddrinfo(host, NULL, &hints, &addr)) goto done;
+    memcpy(&cfg->bind, addr->ai_addr, addr->ai_addrlen);
+    cfg->bind_len = addr->ai_addrlen;
+    freeaddrinfo(addr);
+    ok = true;
+
+  done:
+    zfree(host);
+    return ok;
+}
+
+enum {
+    OPT_TEMPLATE = 256,
+    OPT_CORPUS,
+    OPT_RECONNECT,
+    OPT_TLS_RESUME,
+    OPT_TLS_CIPHERS,
+    OPT_TLS_GROUPS,
+    OPT_KTLS,
+    OPT_TLS_LOWMEM,
+    OPT_TLS_EARLY,
+    OPT_PER_CONN,
+    OPT_CONNECT_RATE,
+    OPT_CLOSE_MODE,
+    OPT_BIND,
+    OPT_TCP_FASTOPEN,
+    OPT_TCP_INFO,
+    OPT_BALANCE,
+    OPT_RESOLVE_INTERVAL,
+    OPT_PROCESSES,
+    OPT_REBALANCE,
+    OPT_BODY_LIMIT
+};
+
 static struct option longopts[] = {
     { "connections", required_argument, NULL, 'c' },
     { "duration",    required_argument, NULL, 'd' },
     { "threads",     required_argument, NULL, 't' },
+    { "processes",   required_argument, NULL, OPT_PROCESSES   },
+    { "rebalance",   no_argument,       NULL, OPT_REBALANCE   },
     { "script",      required_argument, NULL, 's' },
     { "header",      required_argument, NULL, 'H' },
     { "latency",     no_argument,       NULL, 'L' },
+    { "body-limit",  required_argument, NULL, OPT_BODY_LIMIT  },
     { "timeout",     required_argument, NULL, 'T' },
+    { "template",    required_argument, NULL, OPT_TEMPLATE    },
+    { "corpus",      required_argument, NULL, OPT_CORPUS      },
+    { "reconnect",   no_argument,       NULL, OPT_RECONNECT   },
+    { "requests-per-conn", required_argument, NULL, OPT_PER_CONN     },
+    { "connect-rate",      required_argument, NULL, OPT_CONNECT_RATE },
+    { "close-mode",  required_argument, NULL, OPT_CLOSE_MODE  },
+    { "bind",        required_argument, NULL, OPT_BIND        },
+    { "tcp-fastopen", no_argument,      NULL, OPT_TCP_FASTOPEN },
+    { "tcp-info",    no_argument,       NULL, OPT_TCP_INFO    },
+    { "balance",     required_argument, NULL, OPT_BALANCE     },
+    { "resolve-interval", required_argument, NULL, OPT_RESOLVE_INTERVAL },
+    { "tls-resume",  required_argument, NULL, OPT_TLS_RESUME  },
+    { "tls-ciphers", required_argument, NULL, OPT_TLS_CIPHERS },
+    { "tls-groups",  required_argument, NULL, OPT_TLS_GROUPS  },
+    { "ktls",        no_argument,       NULL, OPT_KTLS        },
+    { "tls-lowmem",  no_argument,       NULL, OPT_TLS_LOWMEM  },
+    { "tls-early-data", no_argument,    NULL, OPT_TLS_EARLY   },
     { "help",        no_argument,       NULL, 'h' },
     { "version",     no_argument,       NULL, 'v' },
     { NULL,          0,                 NULL,  0  }
@@ -488,12 +1454,19 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
     cfg->connections = 10;
     cfg->duration    = 10;
     cfg->timeout     = SOCKET_TIMEOUT_MS;
+    cfg->resume      = RESUME_TICKET;
 
     while ((c = getopt_long(argc, argv, "t:c:d:s:H:T:Lrv?", longopts, NULL)) != -1) {
         switch (c) {
             case 't':
                 if (scan_metric(optarg, &cfg->threads)) return -1;
                 break;
+            case OPT_PROCESSES:
+                if (scan_metric(optarg, &cfg->processes)) return -1;
+                break;
+            case OPT_REBALANCE:
+                cfg->rebalance = true;
+                break;
             case 'c':
                 if (scan_metric(optarg, &cfg->connections)) return -1;
                 break;
@@ -509,10 +1482,82 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
             case 'L':
                 cfg->latency = true;
                 break;
+            case OPT_BODY_LIMIT:
+                if (scan_metric(optarg, &cfg->body_limit)) return -1;
+                break;
             case 'T':
                 if (scan_time(optarg, &cfg->timeout)) return -1;
                 cfg->timeout *= 1000;
                 break;
+            case OPT_TEMPLATE:
+                cfg->template = optarg;
+                break;
+            case OPT_CORPUS:
+                cfg->corpus = optarg;
+                break;
+            case OPT_RECONNECT:
+                cfg->per_conn = 1;
+                break;
+            case OPT_PER_CONN:
+                if (scan_metric(optarg, &cfg->per_conn)) return -1;
+                break;
+            case OPT_CONNECT_RATE:
+                if (scan_metric(optarg, &cfg->connect_rate)) return -1;
+                break;
+            case OPT_CLOSE_MODE:
+                if (!strcmp(optarg, "rst")) {
+                    cfg->rst = true;
+                } else if (strcmp(optarg, "graceful")) {
+                    return -1;
+                }
+                break;
+            case OPT_BIND:
+                if (!parse_bind(optarg, cfg)) return -1;
+                break;
+            case OPT_TCP_FASTOPEN:
+                cfg->fastopen = true;
+                break;
+            case OPT_TCP_INFO:
+                cfg->tcp_info = true;
+                break;
+            case OPT_BALANCE:
+                if (!strcmp(optarg, "round-robin")) {
+                    cfg->balance = BALANCE_ROUND_ROBIN;
+                } else if (!strcmp(optarg, "least-inflight")) {
+                    cfg->balance = BALANCE_LEAST_INFLIGHT;
+                } else {
+                    return -1;
+                }
+                break;
+            case OPT_RESOLVE_INTERVAL:
+                if (scan_time(optarg, &cfg->resolve)) return -1;
+                break;
+            case OPT_TLS_RESUME:
+                if (!strcmp(optarg, "none")) {
+                    cfg->resume = RESUME_NONE;
+                } else if (!strcmp(optarg, "ticket")) {
+                    cfg->resume = RESUME_TICKET;
+                } else if (!strcmp(optarg, "id")) {
+                    cfg->resume = RESUME_ID;
+                } else {
+                    return -1;
+                }
+                break;
+            case OPT_TLS_CIPHERS:
+                cfg->ciphers = optarg;
+                break;
+            case OPT_TLS_GROUPS:
+                cfg->groups = optarg;
+                break;
+            case OPT_KTLS:
+                cfg->ktls = true;
+                break;
+            case OPT_TLS_LOWMEM:
+                cfg->lowmem = true;
+                break;
+            case OPT_TLS_EARLY:
+                cfg->early = true;
+                break;
             case 'v':
                 printf("wrk %s [%s] ", VERSION, aeGetApiName());
                 printf("Copyright (C) 2012 Will Glozer\n");
@@ -537,6 +1582,26 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
         return -1;
     }
 
+    if (cfg->port && cfg->port + cfg->connections > 65536) {
+        fprintf(stderr, "not enough source ports for %"PRIu64" connections\n", cfg->connections);
+        return -1;
+    }
+
+    if (cfg->port && !cfg->rst) {
+        fprintf(stderr, "--bind with a port requires --close-mode rst\n");
+        return -1;
+    }
+
+    if (cfg->processes > cfg->threads) {
+        fprintf(stderr, "number of threads must be >= processes\n");
+        return -1;
+    }
+
+    if (cfg->processes && cfg->resolve) {
+        fprintf(stderr, "--resolve-interval cannot be used with --processes\n");
+        return -1;
+    }
+
     *url    = argv[optind];
     *header = NULL;
 
@@ -572,6 +1637,37 @@ static void print_stats(char *name, stats *stats, char *(*fmt)(long double)) {
     printf("%8.2Lf%%\n", stats_within_stdev(stats, mean, stdev, 1));
 }
 
+static void print_stats_steps() {
+    printf("  Step Stats%8s%11s%8s%12s%11s%9s\n", "Avg", "Stdev", "Max", "+/- Stdev", "Requests", "Errors");
+    for (uint64_t i = 0; i < statistics.nsteps; i++) {
+        step *s = &statistics.steps[i];
+        long double mean  = stats_mean(s->latency);
+        long double stdev = stats_stdev(s->latency, mean);
+
+        printf("    %-10s", s->name);
+        print_units(mean,  format_time_us, 8);
+        print_units(stdev, format_time_us, 10);
+        print_units(s->latency->max, format_time_us, 9);
+        printf("%8.2Lf%%", stats_within_stdev(s->latency, mean, stdev, 1));
+        printf("%11"PRIu64"%9"PRIu64"\n", s->latency->count, s->errors);
+    }
+}
+
+static void print_stats_targets() {
+    printf("  Address Stats%19s%11s%8s%12s%9s\n", "Avg", "Stdev", "Max", "Requests", "Errors");
+    for (uint64_t i = 0; i < targets.count; i++) {
+        target *t = targets.all[i];
+        long double mean  = stats_mean(t->latency);
+        long double stdev = stats_stdev(t->latency, mean);
+
+        printf("    %-24s", t->name);
+        print_units(mean,  format_time_us, 8);
+        print_units(stdev, format_time_us, 10);
+        print_units(t->latency->max, format_time_us, 9);
+        printf("%10"PRIu64"%9"PRIu64"\n", t->requests, t->errors);
+    }
+}
+
 static void print_stats_latency(stats *stats) {
     long double percentiles[] = { 50.0, 75.0, 90.0, 99.0 };
     printf("  Latency Distribution\n");
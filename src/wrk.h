@@ -15,34 +15,105 @@
 #include "stats.h"
 #include "ae.h"
 #include "http_parser.h"
+#include "template.h"
+#include "corpus.h"
 
 #define RECVBUF  8192
 
 #define MAX_THREAD_RATE_S   10000000
 #define SOCKET_TIMEOUT_MS   2000
 #define RECORD_INTERVAL_MS  100
+#define MAX_STEPS           32
+#define TCP_INFO_SAMPLES    16
+#define CONNECT_RETRY_MS    10
+#define CONNECT_RETRY_MAX_MS 1000
+#define BUSY_HIGH_PCT       90
+#define BUSY_LOW_PCT        60
+#define BUSY_WARN_PCT       90
+#define LOOP_LAG_WARN_US    10000
+#define BUFFER_POOL         32
+#define BUFFER_POOL_MAX     (64 * 1024)
+#define HANDOFF_CLOSED      ((struct connection *) -1)
 
 extern const char *VERSION;
 
 typedef struct {
+    char  *buffer;
+    size_t length;
+    char  *cursor;
+} buffer;
+
+typedef struct thread {
     pthread_t thread;
+    uint64_t id;
     aeEventLoop *loop;
     struct addrinfo *addr;
     uint64_t connections;
+    uint64_t first;
     uint64_t complete;
     uint64_t requests;
     uint64_t bytes;
     uint64_t start;
+    uint64_t sampled;
+    uint64_t handshakes;
+    uint64_t resumed;
+    uint64_t ktls_send;
+    uint64_t ktls_recv;
+    uint64_t early_accepted;
+    uint64_t early_rejected;
+    uint64_t tfo;
+    uint64_t tfo_accepted;
+    uint64_t tcp_cursor;
+    uint64_t truncated;
+    uint64_t interval;
+    uint64_t next_connect;
+    struct connection *queue;
+    struct connection *tail;
     lua_State *L;
+    SSL_CTX *ctx;
+    template *template;
+    corpus *corpus;
+    uint64_t cursor;
     errors errors;
     struct connection *cs;
+    uint64_t owned;
+    uint64_t sleep;
+    uint64_t idle;
+    uint64_t load_start;
+    uint64_t busy;
+    struct thread *peer;
+    uint64_t budget;
+    struct connection *handoff;
+    uint64_t handoffs;
+    uint64_t idle_us;
+    uint64_t busy_us;
+    uint64_t lua_us;
+    uint64_t lag_max;
+    uint64_t due;
+    uint64_t pooled;
+    buffer pool[BUFFER_POOL];
+    char buf[RECVBUF];
 } thread;
 
 typedef struct {
-    char  *buffer;
-    size_t length;
-    char  *cursor;
-} buffer;
+    char  *name;
+    stats *latency;
+    uint64_t errors;
+} step;
+
+typedef struct {
+    struct addrinfo addr;
+    char *name;
+    stats *latency;
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t inflight;
+} target;
+
+typedef struct {
+    uint64_t count;
+    target *targets[];
+} target_set;
 
 typedef struct connection {
     thread *thread;
@@ -52,15 +123,33 @@ typedef struct connection {
     } state;
     int fd;
     SSL *ssl;
+    SSL_SESSION *session;
     bool delayed;
+    bool sample;
+    bool early;
+    bool resend;
+    bool handoff;
+    bool truncated;
+    enum {
+        RTT_NONE, RTT_ONE, RTT_ZERO
+    } first;
     uint64_t start;
+    uint64_t connect;
     char *request;
     size_t length;
     size_t written;
     uint64_t pending;
+    uint64_t served;
+    uint64_t retrans;
+    uint16_t port;
+    uint32_t failures;
+    struct connection *next;
+    target *target;
+    step *step;
+    lua_State *co;
+    int ref;
     buffer headers;
     buffer body;
-    char buf[RECVBUF];
 } connection;
 
 #endif /* WRK_H */
@@ -47,6 +47,10 @@ function wrk.init(args)
    end
 end
 
+function wrk.step(name, req)
+   return coroutine.yield(name, req or wrk.format())
+end
+
 function wrk.format(method, path, headers, body)
    local method  = method  or wrk.method
    local path    = path    or wrk.path